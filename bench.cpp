@@ -0,0 +1,319 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Microbenchmarks of the primitives on the hot path of the testers
+ */
+
+#include "dns.h"
+#include "dnstester.h"
+#include "histogram.h"
+#include "raii_socket.h"
+#include "spin_sleep.hpp"
+#include "timer.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/socket.h>
+#include <vector>
+
+static std::atomic<uint64_t> allocations{
+    0}; /**< Number of allocations of the process */
+static volatile uint64_t sink; /**< Results kept from being optimized out */
+
+/* Count every allocation of the benchmarked code */
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(size > 0 ? size : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc{};
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+/**
+ * Runs a benchmark and prints its time and allocations per operation.
+ * @param name name of the benchmark
+ * @param n number of operations
+ * @param op the operation, called with its index
+ */
+template <class Op> static void bench(const char *name, uint64_t n, Op op) {
+  uint64_t before = allocations;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (uint64_t i = 0; i < n; i++) {
+    op(i);
+  }
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::high_resolution_clock::now() - start);
+  printf("%-40s %10.1f ns/op %8.2f allocs/op\n", name,
+         (double)time.count() / n, (double)(allocations - before) / n);
+}
+
+/**
+ * Prints the distribution of an error in microseconds.
+ * @param name name of the benchmark
+ * @param histogram the errors in nanoseconds
+ */
+static void print_distribution(const char *name, const Histogram &histogram) {
+  printf("%-40s min/p50/p90/p99/max: %.02f/%.02f/%.02f/%.02f/%.02f us\n", name,
+         histogram.min() / 1000.0, histogram.percentile(50) / 1000.0,
+         histogram.percentile(90) / 1000.0, histogram.percentile(99) / 1000.0,
+         histogram.max() / 1000.0);
+}
+
+/**
+ * Writes the label of an address with a digit table instead of snprintf.
+ * @param label buffer of at least 16 bytes
+ * @param ip the address
+ */
+static void encode_label(char *label, uint32_t ip) {
+  for (int i = 0; i < 4; i++) {
+    uint8_t octet = (ip >> (24 - 8 * i)) & 0xff;
+    label[4 * i] = '0' + octet / 100;
+    label[4 * i + 1] = '0' + octet / 10 % 10;
+    label[4 * i + 2] = '0' + octet % 10;
+    label[4 * i + 3] = '-';
+  }
+  label[15] = '\0';
+}
+
+/**
+ * Reads the address of a label without sscanf.
+ * @param label the label, not terminated
+ * @param len length of the label
+ * @param ip the address to fill
+ * @return false if the label is not the one of an address
+ */
+static bool decode_label(const char *label, size_t len, uint32_t &ip) {
+  if (len != 15) {
+    return false;
+  }
+  ip = 0;
+  for (int i = 0; i < 4; i++) {
+    const char *digits = label + 4 * i;
+    if (i < 3 && digits[3] != '-') {
+      return false;
+    }
+    unsigned octet = 0;
+    for (int j = 0; j < 3; j++) {
+      if (digits[j] < '0' || digits[j] > '9') {
+        return false;
+      }
+      octet = octet * 10 + (digits[j] - '0');
+    }
+    if (octet > 0xff) {
+      return false;
+    }
+    ip = ip << 8 | octet;
+  }
+  return true;
+}
+
+/**
+ * Builds the AAAA answer of a DNS64 server to a query of the tester, the
+ * name of the answer being a compression pointer to the question.
+ * @param buffer buffer of at least 512 bytes
+ * @return the length of the answer
+ */
+static size_t build_answer(uint8_t *buffer) {
+  memset(buffer, 0x00, 512);
+  DNSHeader *header = reinterpret_cast<DNSHeader *>(buffer);
+  header->id(1);
+  header->qr(1);
+  header->opcode(DNSHeader::OpCode::Query);
+  header->rd(true);
+  header->ra(true);
+  header->rcode(DNSHeader::RCODE::NoError);
+  header->qdcount(1);
+  header->ancount(1);
+  uint8_t *pos = buffer + sizeof(DNSHeader);
+  char name[64];
+  snprintf(name, sizeof(name), "%s.%s", "010-000-000-001", dns64_addr_domain);
+  char *label = strtok(name, ".");
+  while (label != nullptr) {
+    *pos++ = strlen(label);
+    memcpy(pos, label, strlen(label));
+    pos += strlen(label);
+    label = strtok(nullptr, ".");
+  }
+  *pos++ = 0x00;
+  uint16_t fields[] = {htons(QType::AAAA), htons(QClass::IN),
+                       htons(0xc000 | sizeof(DNSHeader)), htons(QType::AAAA),
+                       htons(QClass::IN), 0, htons(60), htons(16)};
+  memcpy(pos, fields, sizeof(fields));
+  pos += sizeof(fields);
+  static const uint8_t address[16] = {0x00, 0x64, 0xff, 0x9b, 0, 0, 0, 0,
+                                      0,    0,    0,    0,    10, 0, 0, 1};
+  memcpy(pos, address, sizeof(address));
+  pos += sizeof(address);
+  return pos - buffer;
+}
+
+int main() {
+  const uint64_t n = 1000000;
+  char label[64];
+
+  /* Labels of the queries and the answers */
+  bench("label encode snprintf", n, [&](uint64_t i) {
+    uint32_t ip = 0x0a000000 | (uint32_t)i;
+    snprintf(label, sizeof(label), dns64_addr_format_string, (ip >> 24) & 0xff,
+             (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+    sink = label[14];
+  });
+  bench("label encode digit table", n, [&](uint64_t i) {
+    encode_label(label, 0x0a000000 | (uint32_t)i);
+    sink = label[14];
+  });
+  bench("label decode sscanf", n, [&](uint64_t i) {
+    encode_label(label, 0x0a000000 | (uint32_t)i);
+    uint8_t temp[4];
+    sscanf(label, dns64_addr_format_string, temp, temp + 1, temp + 2,
+           temp + 3);
+    sink = temp[3];
+  });
+  bench("label decode digit loop", n, [&](uint64_t i) {
+    encode_label(label, 0x0a000000 | (uint32_t)i);
+    uint32_t ip;
+    decode_label(label, 15, ip);
+    sink = ip;
+  });
+  /* The alternatives have to give the same labels */
+  for (uint32_t ip : {0x00000000u, 0x0a000001u, 0xc0a8ff7fu, 0xffffffffu}) {
+    char expected[64];
+    uint32_t decoded;
+    snprintf(expected, sizeof(expected), dns64_addr_format_string,
+             (ip >> 24) & 0xff, (ip >> 16) & 0xff, (ip >> 8) & 0xff,
+             ip & 0xff);
+    encode_label(label, ip);
+    if (strcmp(label, expected) != 0 || !decode_label(label, 15, decoded) ||
+        decoded != ip) {
+      fprintf(stderr, "Label alternatives differ for %s\n", expected);
+      return -1;
+    }
+  }
+
+  /* Answers of the receiver */
+  uint8_t answer_data[512];
+  size_t answer_len = build_answer(answer_data);
+  bench("DNSPacket parse AAAA answer", n / 10, [&](uint64_t) {
+    DNSPacket answer{answer_data, answer_len, sizeof(answer_data)};
+    sink = answer.labels_.size();
+  });
+  DNSPacket answer{answer_data, answer_len, sizeof(answer_data)};
+  char name[256];
+  bench("DNSQName::toString compressed", n, [&](uint64_t) {
+    sink = answer.answer_[0].name_.toString(name, sizeof(name));
+  });
+
+  /* Timer of the senders */
+  const size_t ticks = 100000;
+  auto start = std::chrono::high_resolution_clock::now();
+  {
+    Timer timer{"Bench", []() {}, [&]() { sink = sink + 1; },
+                std::chrono::nanoseconds{1}, ticks};
+    timer.start();
+  }
+  printf("%-40s %10.1f ns/op\n", "Timer tick overhead",
+         (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::high_resolution_clock::now() - start)
+                 .count() /
+             ticks);
+  const std::chrono::microseconds interval{100};
+  std::vector<std::chrono::high_resolution_clock::time_point> times;
+  times.reserve(ticks / 10);
+  {
+    Timer timer{"Bench", []() {},
+                [&]() { times.push_back(std::chrono::high_resolution_clock::now()); },
+                interval, ticks / 10};
+    timer.start();
+  }
+  Histogram errors;
+  for (size_t i = 0; i < times.size(); i++) {
+    auto error = times[i] - (times[0] + i * interval);
+    errors.add(std::abs(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(error).count()));
+  }
+  print_distribution("Timer tick error at 100 us", errors);
+  errors.clear();
+  for (size_t i = 0; i < ticks / 10; i++) {
+    auto target = std::chrono::high_resolution_clock::now() + interval / 5;
+    spinsleep::sleep_until(target);
+    errors.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::high_resolution_clock::now() - target)
+                   .count());
+  }
+  print_distribution("spinsleep wake-up error", errors);
+
+  /* Sending the queries over loopback, the receiver does not read them */
+  Socket receiver{::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)};
+  Socket sender{::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)};
+  struct sockaddr_in addr;
+  memset(&addr, 0x00, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len = sizeof(addr);
+  if (::bind(receiver, reinterpret_cast<struct sockaddr *>(&addr),
+             sizeof(addr)) == -1 ||
+      ::getsockname(receiver, reinterpret_cast<struct sockaddr *>(&addr),
+                    &addr_len) == -1) {
+    fprintf(stderr, "Cannot bind the loopback socket: %s\n", strerror(errno));
+    return -1;
+  }
+  size_t query_len = answer_len - 28;
+  bench("sendto loopback", n / 10, [&](uint64_t) {
+    sink = ::sendto(sender, answer_data, query_len, 0,
+                    reinterpret_cast<const struct sockaddr *>(&addr),
+                    sizeof(addr));
+  });
+  const unsigned batch = 32;
+  struct iovec iov;
+  iov.iov_base = answer_data;
+  iov.iov_len = query_len;
+  struct mmsghdr messages[batch];
+  memset(messages, 0x00, sizeof(messages));
+  for (auto &message : messages) {
+    message.msg_hdr.msg_name = &addr;
+    message.msg_hdr.msg_namelen = sizeof(addr);
+    message.msg_hdr.msg_iov = &iov;
+    message.msg_hdr.msg_iovlen = 1;
+  }
+  start = std::chrono::high_resolution_clock::now();
+  uint64_t before = allocations;
+  for (uint64_t i = 0; i < n / 10 / batch; i++) {
+    sink = ::sendmmsg(sender, messages, batch, 0);
+  }
+  printf("%-40s %10.1f ns/op %8.2f allocs/op\n", "sendmmsg loopback, 32 per call",
+         (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::high_resolution_clock::now() - start)
+                 .count() /
+             (n / 10 / batch * batch),
+         (double)(allocations - before) / (n / 10 / batch * batch));
+  return 0;
+}
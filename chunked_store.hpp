@@ -0,0 +1,193 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for a growable store of fixed-size chunks
+ */
+
+#ifndef CHUNKED_STORE_H_INCLUDED_
+#define CHUNKED_STORE_H_INCLUDED_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <vector>
+
+static const unsigned CHUNK_BITS = 16; /**< log2 of elements per chunk */
+static const uint64_t MAX_CHUNKS = 1 << 16; /**< Maximum number of chunks */
+static const uint64_t MAX_ELEMENTS =
+    MAX_CHUNKS << CHUNK_BITS; /**< Maximum number of elements of a store */
+static const size_t HUGE_PAGE_SIZE = 2 << 20; /**< Size of a huge page */
+
+/**
+ * Class to represent a growable array stored in fixed-size chunks.
+ * Growing never moves the elements already stored, so one thread can grow
+ * the store while another one is accessing the elements below the capacity.
+ * The table of the chunks is allocated up front, so reading an element is
+ * lock-free: two indexing steps after an acquire load of the capacity.
+ * The chunks are backed by huge pages where available, to spare TLB misses,
+ * and every element is constructed when its chunk is allocated, so no page
+ * fault happens when the elements are used.
+ */
+template <typename T> class ChunkedStore {
+private:
+  /**
+   * Class to destroy the elements of a chunk and unmap its memory.
+   */
+  struct Unmap {
+    void *base_; /**< Start of the mapping */
+    size_t len_; /**< Length of the mapping */
+
+    void operator()(T *chunk) const {
+      for (uint64_t i = 0; i < (uint64_t)1 << CHUNK_BITS; i++) {
+        chunk[i].~T();
+      }
+      munmap(base_, len_);
+    }
+  };
+
+  std::vector<std::unique_ptr<T, Unmap>> chunks_; /**< Table of the chunks */
+  std::atomic<uint64_t> capacity_; /**< Number of allocated elements */
+  uint64_t size_;                  /**< Number of elements in use */
+  std::mutex m_;                   /**< Mutex for allocating chunks */
+
+  /**
+   * Maps the memory of a chunk and constructs its elements.
+   * Uses the reserved huge pages if there are enough of them, and asks for
+   * transparent huge pages otherwise.
+   * @return the chunk
+   */
+  static std::unique_ptr<T, Unmap> allocate() {
+    size_t size = sizeof(T) << CHUNK_BITS;
+    Unmap unmap;
+    unmap.len_ = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    unmap.base_ = mmap(nullptr, unmap.len_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    T *chunk = static_cast<T *>(unmap.base_);
+    if (unmap.base_ == MAP_FAILED) {
+      /* Transparent huge pages have to be aligned to their size */
+      unmap.len_ = size + HUGE_PAGE_SIZE;
+      unmap.base_ = mmap(nullptr, unmap.len_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (unmap.base_ == MAP_FAILED) {
+        throw std::bad_alloc{};
+      }
+      uintptr_t aligned =
+          ((uintptr_t)unmap.base_ + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+      madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+      chunk = reinterpret_cast<T *>(aligned);
+    }
+    /* Touch every page now, on the NUMA node of the allocating thread */
+    for (uint64_t i = 0; i < (uint64_t)1 << CHUNK_BITS; i++) {
+      new (chunk + i) T{};
+    }
+    return std::unique_ptr<T, Unmap>{chunk, unmap};
+  }
+
+public:
+  /**
+   * Class to iterate over the elements in use.
+   */
+  class const_iterator {
+  private:
+    const ChunkedStore *store_; /**< The store */
+    uint64_t index_;            /**< Index of the element */
+
+  public:
+    const_iterator(const ChunkedStore *store, uint64_t index)
+        : store_{store}, index_{index} {}
+    const T &operator*() const { return (*store_)[index_]; }
+    const_iterator &operator++() {
+      index_++;
+      return *this;
+    }
+    bool operator!=(const const_iterator &rhs) const {
+      return index_ != rhs.index_;
+    }
+  };
+
+  /**
+   * Constructor.
+   */
+  ChunkedStore() : chunks_(MAX_CHUNKS), capacity_{0}, size_{0} {}
+
+  /**
+   * Allocates chunks until there is room for a number of elements.
+   * Can be called from any thread.
+   * @param n the number of elements
+   */
+  void reserve(uint64_t n) {
+    std::lock_guard<std::mutex> lock{m_};
+    uint64_t capacity = capacity_.load(std::memory_order_relaxed);
+    while (capacity < n) {
+      uint64_t chunk = capacity >> CHUNK_BITS;
+      if (chunk >= MAX_CHUNKS) {
+        throw std::length_error{"Too many queries for the query store."};
+      }
+      chunks_[chunk] = allocate();
+      capacity += (uint64_t)1 << CHUNK_BITS;
+      capacity_.store(capacity, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Sets the number of elements in use, allocating chunks if needed.
+   * @param n the number of elements
+   */
+  void resize(uint64_t n) {
+    reserve(n);
+    size_ = n;
+  }
+
+  /**
+   * Getter for the number of allocated elements.
+   * @return the number of elements
+   */
+  uint64_t capacity() const {
+    return capacity_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Getter for the number of elements in use.
+   * @return the number of elements
+   */
+  uint64_t size() const { return size_; }
+
+  T &operator[](uint64_t i) {
+    return chunks_[i >> CHUNK_BITS]
+        .get()[i & (((uint64_t)1 << CHUNK_BITS) - 1)];
+  }
+
+  const T &operator[](uint64_t i) const {
+    return chunks_[i >> CHUNK_BITS]
+        .get()[i & (((uint64_t)1 << CHUNK_BITS) - 1)];
+  }
+
+  const_iterator begin() const { return const_iterator{this, 0}; }
+
+  const_iterator end() const { return const_iterator{this, size_}; }
+};
+
+#endif
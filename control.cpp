@@ -0,0 +1,939 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "control.h"
+#include "affinity.h"
+#include "rate_controller.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <condition_variable>
+#include <cstring>
+#include <endian.h>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+
+static const uint64_t CONTROL_MAX_LEN = (uint64_t)1 << 40;
+static const int CONTROL_BACKLOG = 16;
+
+/* Time points without a value, e.g. before the first connection */
+static const int64_t CONTROL_TIME_MIN = std::numeric_limits<int64_t>::min();
+static const int64_t CONTROL_TIME_MAX = std::numeric_limits<int64_t>::max();
+
+ControlException::ControlException(std::string what) : what_{what} {}
+
+const char *ControlException::what() const noexcept { return what_.c_str(); }
+
+/**
+ * Reads the high resolution clock.
+ * @return nanoseconds since the epoch of the clock
+ */
+static int64_t clock_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::high_resolution_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * Converts a time to the high resolution clock.
+ * @param time nanoseconds since the epoch of the clock
+ * @return the time
+ */
+static std::chrono::high_resolution_clock::time_point clock_time(int64_t time) {
+  return std::chrono::high_resolution_clock::time_point{} +
+         std::chrono::duration_cast<
+             std::chrono::high_resolution_clock::duration>(
+             std::chrono::nanoseconds{time});
+}
+
+/**
+ * Encodes a time relative to a base.
+ * @param time the time
+ * @param base the base
+ * @return nanoseconds since the base
+ */
+static int64_t relative_time(std::chrono::high_resolution_clock::time_point time,
+                             std::chrono::high_resolution_clock::time_point base) {
+  if (time == std::chrono::high_resolution_clock::time_point::min()) {
+    return CONTROL_TIME_MIN;
+  } else if (time == std::chrono::high_resolution_clock::time_point::max()) {
+    return CONTROL_TIME_MAX;
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time - base)
+      .count();
+}
+
+/**
+ * Decodes a time of an agent relative to a base.
+ * @param time nanoseconds since the base
+ * @param clock the clock of the agent
+ * @param base the base on the clock of the agent
+ * @return the time on the local clock
+ */
+static std::chrono::high_resolution_clock::time_point
+remote_time(int64_t time, const ClockModel &clock, int64_t base) {
+  if (time == CONTROL_TIME_MIN) {
+    return std::chrono::high_resolution_clock::time_point::min();
+  } else if (time == CONTROL_TIME_MAX) {
+    return std::chrono::high_resolution_clock::time_point::max();
+  }
+  return clock.local(base + time);
+}
+
+/**
+ * Creates a TCP socket with the options of a control connection.
+ * @return the socket
+ */
+static Socket control_socket() {
+  int sockfd;
+  if ((sockfd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+    std::stringstream ss;
+    ss << "Cannot create socket: " << strerror(errno);
+    throw ControlException{ss.str()};
+  }
+  Socket sock{sockfd};
+  int one = 1;
+  ::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+               reinterpret_cast<const void *>(&one), sizeof(one));
+  return sock;
+}
+
+TestSetup::TestSetup()
+    : port_{53}, ip_{0}, netmask_{32}, num_req_{0}, num_burst_{1},
+      num_thread_{1}, burst_delay_{0} {
+  memset(&server_addr_, 0x00, sizeof(server_addr_));
+  memset(&timeout_, 0x00, sizeof(timeout_));
+}
+
+bool TestSetup::same_transport(const TestSetup &rhs) const {
+  return server_addr_.s_addr == rhs.server_addr_.s_addr &&
+         port_ == rhs.port_ && num_thread_ == rhs.num_thread_ &&
+         timeout_.tv_sec == rhs.timeout_.tv_sec &&
+         timeout_.tv_usec == rhs.timeout_.tv_usec && cpus_ == rhs.cpus_ &&
+         options_.transport_ == rhs.options_.transport_ &&
+         options_.tls_sessions_ == rhs.options_.tls_sessions_ &&
+         options_.tls_resumption_ == rhs.options_.tls_resumption_ &&
+         options_.h2_streams_ == rhs.options_.h2_streams_ &&
+         options_.doh_path_ == rhs.options_.doh_path_ &&
+         options_.tcp_fastopen_ == rhs.options_.tcp_fastopen_ &&
+         options_.tc_retry_ == rhs.options_.tc_retry_ &&
+         options_.txtime_clock_ == rhs.options_.txtime_clock_;
+}
+
+std::vector<std::unique_ptr<DnsTester>> TestSetup::run(
+    uint32_t first, uint32_t thread_num,
+    std::function<std::chrono::high_resolution_clock::time_point()> start,
+    std::vector<std::unique_ptr<Transport>> &transports) const {
+  /* Tester i takes over the transport of tester i of the previous test */
+  transports.resize(num_thread_);
+  std::vector<std::unique_ptr<DnsTester>> testers(num_thread_);
+  std::vector<std::exception_ptr> errors(num_thread_);
+  std::vector<std::thread> threads;
+  /* Barrier of the end of the setup */
+  std::mutex m;
+  std::condition_variable cv;
+  uint32_t num_ready = 0;
+  bool started = false, aborted = false;
+  std::atomic<uint32_t> num_finished{0};
+  std::chrono::high_resolution_clock::time_point reference_time;
+  for (uint32_t i = 0; i < num_thread_; i++) {
+    threads.emplace_back([&, i]() {
+      bool ready = false;
+      try {
+        int receiver_cpu = -1, sender_cpu = -1;
+        if (!cpus_.empty()) {
+          receiver_cpu = cpus_[(2 * i) % cpus_.size()];
+          sender_cpu = cpus_[(2 * i + 1) % cpus_.size()];
+        }
+        /* Pin first, so the memory of the tester is first touched here */
+        affinity::pin(receiver_cpu);
+        uint32_t id = first + i;
+        testers[i] = std::make_unique<DnsTester>(
+            server_addr_, port_, ip_, netmask_, num_req_, num_burst_,
+            thread_num, id, std::chrono::nanoseconds{burst_delay_}, timeout_,
+            options_, std::move(transports[i]));
+        {
+          std::unique_lock<std::mutex> lock{m};
+          ready = true;
+          num_ready++;
+          cv.notify_all();
+          cv.wait(lock, [&]() { return started || aborted; });
+          if (aborted) {
+            return;
+          }
+        }
+        /* The bursts of the timers are spread evenly, a closed loop has no
+         * bursts */
+        uint64_t stagger =
+            options_.concurrency_ > 0 ? 0 : burst_delay_ / thread_num;
+        testers[i]->start(
+            reference_time + std::chrono::nanoseconds{stagger} * id,
+            sender_cpu);
+      } catch (...) {
+        errors[i] = std::current_exception();
+        if (!ready) {
+          std::lock_guard<std::mutex> lock{m};
+          num_ready++;
+          cv.notify_all();
+        }
+      }
+      num_finished++;
+    });
+    pthread_setname_np(threads.back().native_handle(),
+                       ("Receiver " + std::to_string(first + i)).c_str());
+  }
+  /* Start the test when every tester is ready, unless one has failed */
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock{m};
+    cv.wait(lock, [&]() { return num_ready == num_thread_; });
+    for (const auto &tester_error : errors) {
+      if (tester_error) {
+        error = tester_error;
+        break;
+      }
+    }
+  }
+  if (!error) {
+    try {
+      reference_time = start();
+    } catch (...) {
+      error = std::current_exception();
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock{m};
+    started = !error;
+    aborted = !!error;
+    cv.notify_all();
+  }
+  if (!error && options_.slo_latency_.count() > 0) {
+    RateController controller{testers, num_burst_, burst_delay_, options_};
+    controller.run(reference_time,
+                   [&]() { return num_finished == num_thread_; });
+  }
+  for (uint32_t i = 0; i < num_thread_; i++) {
+    threads[i].join();
+  }
+  if (error) {
+    transports.clear();
+    std::rethrow_exception(error);
+  }
+  for (const auto &tester_error : errors) {
+    if (tester_error) {
+      transports.clear();
+      std::rethrow_exception(tester_error);
+    }
+  }
+  for (uint32_t i = 0; i < num_thread_; i++) {
+    transports[i] = testers[i]->release_transport();
+  }
+  return testers;
+}
+
+ClockSample::ClockSample() : offset_{0}, delay_{0}, time_{0} {}
+
+ClockModel::ClockModel(const ClockSample &start, const ClockSample &end)
+    : start_(start), end_(end) {}
+
+double ClockModel::skew() const {
+  if (end_.time_ == start_.time_) {
+    return 0;
+  }
+  return (double)(end_.offset_ - start_.offset_) /
+         (end_.time_ - start_.time_);
+}
+
+int64_t ClockModel::error() const {
+  return std::max(start_.delay_, end_.delay_) / 2;
+}
+
+int64_t ClockModel::offset() const { return start_.offset_; }
+
+std::chrono::high_resolution_clock::time_point
+ClockModel::local(int64_t time) const {
+  /* The skew is tiny, so the offset at the start is good enough to find the
+   * time on the clock of the coordinator to interpolate at */
+  int64_t offset =
+      start_.offset_ +
+      (int64_t)(skew() * (double)(time - start_.offset_ - start_.time_));
+  return clock_time(time - offset);
+}
+
+ControlMessage::ControlMessage(Type type) : pos_{1} {
+  data_.push_back(static_cast<uint8_t>(type));
+}
+
+ControlMessage::Type ControlMessage::type() const {
+  return static_cast<Type>(data_[0]);
+}
+
+void ControlMessage::check(size_t len) const {
+  if (data_.size() - pos_ < len) {
+    throw ControlException{"Truncated control message."};
+  }
+}
+
+void ControlMessage::put8(uint8_t value) { data_.push_back(value); }
+
+void ControlMessage::put32(uint32_t value) {
+  value = htobe32(value);
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+  data_.insert(data_.end(), bytes, bytes + sizeof(value));
+}
+
+void ControlMessage::put64(uint64_t value) {
+  value = htobe64(value);
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+  data_.insert(data_.end(), bytes, bytes + sizeof(value));
+}
+
+void ControlMessage::put_double(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put64(bits);
+}
+
+void ControlMessage::put_string(const std::string &value) {
+  put64(value.size());
+  data_.insert(data_.end(), value.begin(), value.end());
+}
+
+void ControlMessage::put(const Histogram &histogram) {
+  put64(histogram.buckets_.size());
+  for (uint64_t bucket : histogram.buckets_) {
+    put64(bucket);
+  }
+  put64(histogram.count_);
+  put64(histogram.min_);
+  put64(histogram.max_);
+  put_double(histogram.sum_);
+}
+
+void ControlMessage::put(const TransportStats &stats,
+                         std::chrono::high_resolution_clock::time_point base) {
+  put64(stats.handshakes_);
+  put64(stats.resumed_handshakes_);
+  put64(stats.handshake_time_.count());
+  put64(stats.resumed_handshake_time_.count());
+  put64(relative_time(stats.first_handshake_, base));
+  put64(relative_time(stats.last_handshake_, base));
+  put64(stats.disconnects_);
+  put64(stats.stream_waits_);
+  put64(stats.stream_wait_time_.count());
+  put64(stats.stream_errors_);
+  put64(stats.stream_timeouts_);
+  put64(stats.connections_.size());
+  for (const auto &connection : stats.connections_) {
+    put(connection);
+  }
+  put64(stats.tcp_connections_);
+  put64(stats.tcp_failures_);
+  put64(stats.tcp_timeouts_);
+  put64(stats.fastopen_connections_);
+  put(stats.connect_time_);
+  put(stats.response_time_);
+  put(stats.exchange_time_);
+  put64(relative_time(stats.first_connect_, base));
+  put64(relative_time(stats.last_connect_, base));
+  put64(stats.truncated_);
+  put64(stats.txtime_drops_);
+  put64(stats.send_errors_);
+}
+
+void ControlMessage::put(const TestSetup &setup) {
+  put32(CONTROL_VERSION);
+  put32(ntohl(setup.server_addr_.s_addr));
+  put32(setup.port_);
+  put32(setup.ip_);
+  put8(setup.netmask_);
+  put64(setup.num_req_);
+  put32(setup.num_burst_);
+  put32(setup.num_thread_);
+  put64(setup.burst_delay_);
+  put64(setup.timeout_.tv_sec);
+  put64(setup.timeout_.tv_usec);
+  const TesterOptions &options = setup.options_;
+  put8(static_cast<uint8_t>(options.transport_));
+  put32(options.tls_sessions_);
+  put8(options.tls_resumption_);
+  put32(options.h2_streams_);
+  put_string(options.doh_path_);
+  put8(options.tcp_fastopen_);
+  put8(options.tc_retry_);
+  put32(options.retries_);
+  put64(options.retry_interval_.count());
+  put_double(options.retry_backoff_);
+  put8(options.epoch_label_);
+  put64(options.first_epoch_);
+  put64(options.duration_.count());
+  put64(options.warmup_queries_);
+  put64(options.warmup_duration_.count());
+  put32(options.concurrency_);
+  put64(options.slo_latency_.count());
+  put_double(options.slo_loss_);
+  put8(options.pace_);
+  put32(options.txtime_clock_);
+  put8(options.perf_counters_);
+}
+
+void ControlMessage::put(const DnsTester &tester) {
+  put32(ntohl(tester.server_.sin_addr.s_addr));
+  put32(ntohs(tester.server_.sin_port));
+  put32(tester.ip_);
+  put8(tester.netmask_);
+  put64(tester.num_req_);
+  put32(tester.num_burst_);
+  put32(tester.num_thread_);
+  put32(tester.thread_id_);
+  put64(tester.num_offset_);
+  put64(tester.stride_);
+  put8(tester.epoch_label_);
+  put64(tester.first_epoch_);
+  put64(tester.burst_delay_.count());
+  put64(tester.duration_.count());
+  put64(tester.timeout_.tv_sec);
+  put64(tester.timeout_.tv_usec);
+  put32(tester.retries_);
+  put64(tester.num_duplicate_);
+  put64(tester.num_late_);
+  put8(tester.finished_early_);
+  put64(tester.tail_wait_.count());
+  put64(tester.setup_time_.count());
+  put64(tester.num_warmup_);
+  put32(tester.concurrency_);
+  put8(tester.txtime_);
+  put8(tester.perf_counters_);
+  put(tester.slip_);
+  for (const PerfCounts *counts :
+       {&tester.sender_counts_, &tester.receiver_counts_}) {
+    put64(counts->cycles_);
+    put64(counts->instructions_);
+    put64(counts->cache_misses_);
+    put64(counts->context_switches_);
+    put64(counts->page_faults_);
+  }
+  put(tester.transport_stats_, tester.test_start_time_);
+  put64(tester.tests_.size());
+  for (const auto &query : tester.tests_) {
+    put64(relative_time(query.time_sent_, tester.test_start_time_));
+    put8(query.received_ | query.answered_ << 1 | query.timed_out_ << 2);
+    if (query.received_) {
+      put64(relative_time(query.time_received_, tester.test_start_time_));
+    }
+    put64(query.rtt_.count());
+    put8(query.retries_);
+  }
+}
+
+uint8_t ControlMessage::get8() {
+  check(sizeof(uint8_t));
+  return data_[pos_++];
+}
+
+uint32_t ControlMessage::get32() {
+  uint32_t value;
+  check(sizeof(value));
+  memcpy(&value, data_.data() + pos_, sizeof(value));
+  pos_ += sizeof(value);
+  return be32toh(value);
+}
+
+uint64_t ControlMessage::get64() {
+  uint64_t value;
+  check(sizeof(value));
+  memcpy(&value, data_.data() + pos_, sizeof(value));
+  pos_ += sizeof(value);
+  return be64toh(value);
+}
+
+double ControlMessage::get_double() {
+  uint64_t bits = get64();
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+std::string ControlMessage::get_string() {
+  uint64_t len = get64();
+  check(len);
+  std::string value{data_.begin() + pos_, data_.begin() + pos_ + len};
+  pos_ += len;
+  return value;
+}
+
+void ControlMessage::get(Histogram &histogram) {
+  if (get64() != histogram.buckets_.size()) {
+    throw ControlException{"Histogram of a different version."};
+  }
+  for (auto &bucket : histogram.buckets_) {
+    bucket = get64();
+  }
+  histogram.count_ = get64();
+  histogram.min_ = get64();
+  histogram.max_ = get64();
+  histogram.sum_ = get_double();
+}
+
+void ControlMessage::get(TransportStats &stats, const ClockModel &clock,
+                         int64_t base) {
+  stats.handshakes_ = get64();
+  stats.resumed_handshakes_ = get64();
+  stats.handshake_time_ = std::chrono::nanoseconds{get64()};
+  stats.resumed_handshake_time_ = std::chrono::nanoseconds{get64()};
+  stats.first_handshake_ = remote_time(get64(), clock, base);
+  stats.last_handshake_ = remote_time(get64(), clock, base);
+  stats.disconnects_ = get64();
+  stats.stream_waits_ = get64();
+  stats.stream_wait_time_ = std::chrono::nanoseconds{get64()};
+  stats.stream_errors_ = get64();
+  stats.stream_timeouts_ = get64();
+  stats.connections_.resize(get64());
+  for (auto &connection : stats.connections_) {
+    get(connection);
+  }
+  stats.tcp_connections_ = get64();
+  stats.tcp_failures_ = get64();
+  stats.tcp_timeouts_ = get64();
+  stats.fastopen_connections_ = get64();
+  get(stats.connect_time_);
+  get(stats.response_time_);
+  get(stats.exchange_time_);
+  stats.first_connect_ = remote_time(get64(), clock, base);
+  stats.last_connect_ = remote_time(get64(), clock, base);
+  stats.truncated_ = get64();
+  stats.txtime_drops_ = get64();
+  stats.send_errors_ = get64();
+}
+
+void ControlMessage::get(TestSetup &setup) {
+  if (get32() != CONTROL_VERSION) {
+    throw ControlException{"Coordinator of a different version."};
+  }
+  setup.server_addr_.s_addr = htonl(get32());
+  setup.port_ = get32();
+  setup.ip_ = get32();
+  setup.netmask_ = get8();
+  setup.num_req_ = get64();
+  setup.num_burst_ = get32();
+  setup.num_thread_ = get32();
+  setup.burst_delay_ = get64();
+  setup.timeout_.tv_sec = get64();
+  setup.timeout_.tv_usec = get64();
+  TesterOptions &options = setup.options_;
+  options.transport_ = static_cast<TransportType>(get8());
+  options.tls_sessions_ = get32();
+  options.tls_resumption_ = get8();
+  options.h2_streams_ = get32();
+  options.doh_path_ = get_string();
+  options.tcp_fastopen_ = get8();
+  options.tc_retry_ = get8();
+  options.retries_ = get32();
+  options.retry_interval_ = std::chrono::nanoseconds{get64()};
+  options.retry_backoff_ = get_double();
+  options.epoch_label_ = get8();
+  options.first_epoch_ = get64();
+  options.duration_ = std::chrono::nanoseconds{get64()};
+  options.warmup_queries_ = get64();
+  options.warmup_duration_ = std::chrono::nanoseconds{get64()};
+  options.concurrency_ = get32();
+  options.slo_latency_ = std::chrono::nanoseconds{get64()};
+  options.slo_loss_ = get_double();
+  options.pace_ = get8();
+  options.txtime_clock_ = get32();
+  options.perf_counters_ = get8();
+}
+
+std::unique_ptr<DnsTester> ControlMessage::get_tester(const ClockModel &clock,
+                                                      int64_t reference_time) {
+  std::unique_ptr<DnsTester> tester{new DnsTester{}};
+  tester->server_.sin_family = AF_INET;
+  tester->server_.sin_addr.s_addr = htonl(get32());
+  tester->server_.sin_port = htons(get32());
+  tester->ip_ = get32();
+  tester->netmask_ = get8();
+  tester->num_req_ = get64();
+  tester->num_burst_ = get32();
+  tester->num_thread_ = get32();
+  tester->thread_id_ = get32();
+  tester->num_offset_ = get64();
+  tester->stride_ = get64();
+  tester->epoch_label_ = get8();
+  tester->first_epoch_ = get64();
+  tester->burst_delay_ = std::chrono::nanoseconds{get64()};
+  tester->duration_ = std::chrono::nanoseconds{get64()};
+  tester->timeout_.tv_sec = get64();
+  tester->timeout_.tv_usec = get64();
+  tester->retries_ = get32();
+  tester->num_duplicate_ = get64();
+  tester->num_late_ = get64();
+  tester->finished_early_ = get8();
+  tester->tail_wait_ = std::chrono::nanoseconds{get64()};
+  tester->setup_time_ = std::chrono::nanoseconds{get64()};
+  tester->num_warmup_ = get64();
+  tester->concurrency_ = get32();
+  tester->txtime_ = get8();
+  tester->perf_counters_ = get8();
+  get(tester->slip_);
+  for (PerfCounts *counts :
+       {&tester->sender_counts_, &tester->receiver_counts_}) {
+    counts->cycles_ = get64();
+    counts->instructions_ = get64();
+    counts->cache_misses_ = get64();
+    counts->context_switches_ = get64();
+    counts->page_faults_ = get64();
+  }
+  if (tester->num_thread_ == 0) {
+    throw ControlException{"Tester without threads."};
+  }
+  /* Start time of the tester on the clock of the agent, as in TestSetup::run */
+  int64_t stagger = tester->concurrency_ > 0 ? 0
+                                             : tester->burst_delay_.count() /
+                                                   tester->num_thread_;
+  int64_t base = reference_time + stagger * tester->thread_id_;
+  tester->test_start_time_ = clock.local(base);
+  get(tester->transport_stats_, clock, base);
+  uint64_t num_queries = get64();
+  tester->tests_.resize(num_queries);
+  tester->num_sent_ = num_queries;
+  for (uint64_t i = 0; i < num_queries; i++) {
+    DnsQuery &query = tester->tests_[i];
+    query.time_sent_ = remote_time(get64(), clock, base);
+    uint8_t flags = get8();
+    query.received_ = flags & 0x01;
+    query.answered_ = flags & 0x02;
+    query.timed_out_ = flags & 0x04;
+    if (query.received_) {
+      query.time_received_ = remote_time(get64(), clock, base);
+    }
+    query.rtt_ = std::chrono::nanoseconds{get64()};
+    query.retries_ = get8();
+  }
+  return tester;
+}
+
+void ControlMessage::send(int fd) const {
+  uint64_t len = htobe64(data_.size());
+  struct iovec iov[2];
+  iov[0].iov_base = &len;
+  iov[0].iov_len = sizeof(len);
+  iov[1].iov_base = const_cast<uint8_t *>(data_.data());
+  iov[1].iov_len = data_.size();
+  struct msghdr msg;
+  memset(&msg, 0x00, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  while (msg.msg_iovlen > 0) {
+    ssize_t sent = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::stringstream ss;
+      ss << "Cannot send control message: " << strerror(errno);
+      throw ControlException{ss.str()};
+    }
+    /* Skip the part already sent */
+    while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+      sent -= msg.msg_iov->iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen > 0) {
+      msg.msg_iov->iov_base = static_cast<uint8_t *>(msg.msg_iov->iov_base) + sent;
+      msg.msg_iov->iov_len -= sent;
+    }
+  }
+}
+
+/**
+ * Receives an exact amount of data.
+ * @param fd the connection
+ * @param buffer the buffer to receive into
+ * @param len the amount of data
+ * @return false if the connection was closed before the data
+ */
+static bool receive_all(int fd, uint8_t *buffer, size_t len) {
+  size_t received = 0;
+  while (received < len) {
+    ssize_t recvlen = ::recv(fd, buffer + received, len - received, 0);
+    if (recvlen == 0 && received == 0) {
+      return false;
+    } else if (recvlen == 0) {
+      throw ControlException{"Control connection closed."};
+    } else if (recvlen < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::stringstream ss;
+      ss << "Cannot receive control message: " << strerror(errno);
+      throw ControlException{ss.str()};
+    }
+    received += recvlen;
+  }
+  return true;
+}
+
+bool ControlMessage::receive(int fd) {
+  uint64_t len;
+  if (!receive_all(fd, reinterpret_cast<uint8_t *>(&len), sizeof(len))) {
+    return false;
+  }
+  len = be64toh(len);
+  if (len < 1 || len > CONTROL_MAX_LEN) {
+    throw ControlException{"Bad control message length."};
+  }
+  data_.resize(len);
+  if (!receive_all(fd, data_.data(), len)) {
+    throw ControlException{"Control connection closed."};
+  }
+  pos_ = 1;
+  return true;
+}
+
+Coordinator::Coordinator(const std::vector<struct sockaddr_in> &agents) {
+  for (const auto &agent : agents) {
+    Socket sock = control_socket();
+    if (::connect(sock, reinterpret_cast<const struct sockaddr *>(&agent),
+                  sizeof(agent)) == -1) {
+      char agent_text[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, reinterpret_cast<const void *>(&agent.sin_addr),
+                agent_text, sizeof(agent_text));
+      std::stringstream ss;
+      ss << "Cannot connect to agent " << agent_text << ":"
+         << ntohs(agent.sin_port) << ": " << strerror(errno);
+      throw ControlException{ss.str()};
+    }
+    agents_.push_back(std::move(sock));
+  }
+}
+
+void Coordinator::expect(size_t agent, ControlMessage &message,
+                         ControlMessage::Type type) {
+  if (!message.receive(agents_[agent])) {
+    throw ControlException{"Control connection closed."};
+  }
+  if (message.type() == ControlMessage::Type::Error) {
+    std::stringstream ss;
+    ss << "Agent " << agent << " failed: " << message.get_string();
+    throw ControlException{ss.str()};
+  } else if (message.type() != type) {
+    throw ControlException{"Unexpected control message."};
+  }
+}
+
+ClockSample Coordinator::synchronize(size_t agent) {
+  ClockSample best;
+  best.delay_ = std::numeric_limits<int64_t>::max();
+  for (unsigned i = 0; i < CONTROL_CLOCK_SAMPLES; i++) {
+    ControlMessage request{ControlMessage::Type::TimeRequest};
+    int64_t t1 = clock_now();
+    request.put64(t1);
+    request.send(agents_[agent]);
+    ControlMessage reply;
+    if (!reply.receive(agents_[agent])) {
+      throw ControlException{"Control connection closed."};
+    }
+    int64_t t4 = clock_now();
+    if (reply.type() != ControlMessage::Type::TimeReply ||
+        (int64_t)reply.get64() != t1) {
+      throw ControlException{"Unexpected control message."};
+    }
+    int64_t t2 = reply.get64();
+    int64_t t3 = reply.get64();
+    /* The exchange with the shortest round-trip time is the most accurate */
+    ClockSample sample;
+    sample.offset_ = ((t2 - t1) + (t3 - t4)) / 2;
+    sample.delay_ = (t4 - t1) - (t3 - t2);
+    sample.time_ = t1 + (t4 - t1) / 2;
+    if (sample.delay_ < best.delay_) {
+      best = sample;
+    }
+  }
+  return best;
+}
+
+std::vector<std::unique_ptr<DnsTester>>
+Coordinator::run(const TestSetup &setup) {
+  uint32_t thread_num = setup.num_thread_ * agents_.size();
+  std::vector<ClockSample> starts;
+  for (size_t i = 0; i < agents_.size(); i++) {
+    starts.push_back(synchronize(i));
+  }
+  for (size_t i = 0; i < agents_.size(); i++) {
+    ControlMessage message{ControlMessage::Type::Setup};
+    message.put(setup);
+    message.put32(i * setup.num_thread_);
+    message.put32(thread_num);
+    message.send(agents_[i]);
+  }
+  std::vector<ControlMessage> results(agents_.size());
+  for (size_t i = 0; i < agents_.size(); i++) {
+    expect(i, results[i], ControlMessage::Type::Ready);
+  }
+  /* Every agent starts at the same time, given on its own clock */
+  int64_t start_time =
+      clock_now() +
+      std::chrono::duration_cast<std::chrono::nanoseconds>(START_DELAY).count();
+  for (size_t i = 0; i < agents_.size(); i++) {
+    ControlMessage message{ControlMessage::Type::Start};
+    message.put64(start_time + starts[i].offset_);
+    message.send(agents_[i]);
+  }
+  for (size_t i = 0; i < agents_.size(); i++) {
+    expect(i, results[i], ControlMessage::Type::Results);
+  }
+  /* Collect the testers as if they were local, on the clock of the
+   * coordinator */
+  std::vector<std::unique_ptr<DnsTester>> testers;
+  for (size_t i = 0; i < agents_.size(); i++) {
+    ClockModel clock{starts[i], synchronize(i)};
+    printf("Agent %zu: clock offset %.03f ms, skew %.02f ppm, "
+           "error +/-%.03f ms\n",
+           i, clock.offset() / 1000000.0, clock.skew() * 1000000.0,
+           clock.error() / 1000000.0);
+    uint32_t num_testers = results[i].get32();
+    for (uint32_t j = 0; j < num_testers; j++) {
+      testers.push_back(
+          results[i].get_tester(clock, start_time + starts[i].offset_));
+    }
+  }
+  return testers;
+}
+
+Agent::Agent(uint16_t port, const std::vector<int> &cpus)
+    : sock_{control_socket()}, cpus_(cpus) {
+  int one = 1;
+  ::setsockopt(sock_, SOL_SOCKET, SO_REUSEADDR,
+               reinterpret_cast<const void *>(&one), sizeof(one));
+  struct sockaddr_in local_addr;
+  memset(&local_addr, 0x00, sizeof(local_addr));
+  local_addr.sin_family = AF_INET;
+  local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  local_addr.sin_port = htons(port);
+  if (::bind(sock_, reinterpret_cast<struct sockaddr *>(&local_addr),
+             sizeof(local_addr)) == -1 ||
+      ::listen(sock_, CONTROL_BACKLOG) == -1) {
+    std::stringstream ss;
+    ss << "Unable to listen for the coordinator: " << strerror(errno);
+    throw ControlException{ss.str()};
+  }
+}
+
+void Agent::test(int fd, ControlMessage &message) {
+  TestSetup setup;
+  message.get(setup);
+  /* The CPUs are specific to the host of the agent */
+  setup.cpus_ = cpus_;
+  uint32_t first = message.get32();
+  uint32_t thread_num = message.get32();
+  if (setup.num_thread_ == 0 || first + setup.num_thread_ > thread_num) {
+    throw ControlException{"Bad tester ids."};
+  }
+  fprintf(stderr, "Running testers %u-%u of %u.\n", first,
+          first + setup.num_thread_ - 1, thread_num);
+  /* The connections of the previous phase are kept if they fit */
+  if (!setup.same_transport(previous_)) {
+    transports_.clear();
+  }
+  previous_ = setup;
+  std::vector<std::unique_ptr<DnsTester>> testers;
+  try {
+    testers = setup.run(
+        first, thread_num,
+        [fd]() {
+          /* Wait for the other agents to be ready too */
+          ControlMessage ready{ControlMessage::Type::Ready};
+          ready.send(fd);
+          ControlMessage start;
+          if (!start.receive(fd)) {
+            throw ControlException{"Control connection closed."};
+          } else if (start.type() != ControlMessage::Type::Start) {
+            throw ControlException{"Unexpected control message."};
+          }
+          return clock_time(start.get64());
+        },
+        transports_);
+  } catch (std::exception &e) {
+    ControlMessage error{ControlMessage::Type::Error};
+    error.put_string(e.what());
+    error.send(fd);
+    throw;
+  }
+  ControlMessage results{ControlMessage::Type::Results};
+  results.put32(testers.size());
+  for (const auto &tester : testers) {
+    results.put(*tester);
+  }
+  results.send(fd);
+  DnsTesterAggregator aggregator(testers);
+  aggregator.display();
+  fflush(stdout);
+}
+
+void Agent::serve() {
+  for (;;) {
+    int connfd;
+    if ((connfd = ::accept(sock_, nullptr, nullptr)) == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      std::stringstream ss;
+      ss << "Cannot accept the coordinator: " << strerror(errno);
+      throw ControlException{ss.str()};
+    }
+    Socket connection{connfd};
+    /* A new coordinator starts with new transports */
+    transports_.clear();
+    try {
+      ControlMessage message;
+      while (message.receive(connection)) {
+        int64_t t2 = clock_now();
+        switch (message.type()) {
+        case ControlMessage::Type::TimeRequest: {
+          ControlMessage reply{ControlMessage::Type::TimeReply};
+          reply.put64(message.get64());
+          reply.put64(t2);
+          reply.put64(clock_now());
+          reply.send(connection);
+          break;
+        }
+        case ControlMessage::Type::Setup:
+          test(connection, message);
+          break;
+        default:
+          throw ControlException{"Unexpected control message."};
+        }
+      }
+    } catch (std::exception &e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+}
@@ -0,0 +1,364 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the coordination of distributed tests
+ */
+
+#ifndef CONTROL_H_INCLUDED_
+#define CONTROL_H_INCLUDED_
+
+#include "dnstester.h"
+#include "histogram.h"
+#include "raii_socket.h"
+#include "transport.h"
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+
+static const uint32_t CONTROL_VERSION = 13; /**< Version of the protocol */
+static const std::chrono::milliseconds START_DELAY{
+    100}; /**< Time between the end of the setup and the start of a test */
+static const unsigned CONTROL_CLOCK_SAMPLES =
+    8; /**< Number of exchanges to estimate the clock offset */
+
+/**
+ * An std::exception class for the control protocol.
+ */
+class ControlException : public std::exception {
+private:
+  std::string what_; /**< Exception string */
+public:
+  /**
+   * A constructor.
+   * @param what the exception string
+   */
+  ControlException(std::string what);
+
+  /**
+   * A getter for the exception string.
+   * @return the exception string
+   */
+  const char *what() const noexcept override;
+};
+
+/**
+ * Class to store the parameters of a test given on the command line
+ */
+struct TestSetup {
+  struct in_addr server_addr_; /**< Address of the server */
+  uint16_t port_;              /**< Port of the server */
+  uint32_t ip_;                /**< IP part of the subnet */
+  uint8_t netmask_;            /**< Netmask part of the subnet */
+  uint64_t num_req_;           /**< Number of requests of the whole test */
+  uint32_t num_burst_;         /**< Burst size */
+  uint32_t num_thread_;        /**< Number of threads of one process */
+  uint64_t burst_delay_;       /**< Time between bursts in nanoseconds */
+  struct timeval timeout_;     /**< Timeout of the queries */
+  TesterOptions options_;      /**< Optional parameters of the test */
+  std::vector<int> cpus_; /**< CPUs of the threads of this host, or empty */
+
+  TestSetup();
+
+  /**
+   * Checks whether the testers of this setup can take over the transports of
+   * the testers of another one: the same server, number of threads and
+   * transport with the same parameters.
+   * @param rhs the setup of the previous test
+   * @return true if the transports can be reused
+   */
+  bool same_transport(const TestSetup &rhs) const;
+
+  /**
+   * Runs num_thread_ testers of a test and waits for them to finish.
+   * Every tester is created by its receiver thread, pinned to the next CPU
+   * of cpus_, so its memory is allocated on the NUMA node of the CPU. Its
+   * sender is pinned to the CPU after that. The testers are set up in
+   * parallel, and the start time is only determined when all of them are
+   * ready, so a long setup does not delay the first bursts.
+   * @param first id of the first tester
+   * @param thread_num number of testers of the whole test
+   * @param start called when every tester is ready, returns the start time
+   * of the tester with id 0
+   * @param transports the transports of the previous test to take over, one
+   * per thread, or empty; replaced by the transports of this test
+   * @return the finished testers
+   */
+  std::vector<std::unique_ptr<DnsTester>>
+  run(uint32_t first, uint32_t thread_num,
+      std::function<std::chrono::high_resolution_clock::time_point()> start,
+      std::vector<std::unique_ptr<Transport>> &transports) const;
+};
+
+/**
+ * Class to represent one NTP-style estimate of the clock of an agent.
+ * The coordinator sends its time t1, the agent answers with its times of
+ * receiving (t2) and sending (t3) the answer, and the coordinator receives
+ * the answer at t4. The offset of the agent is ((t2 - t1) + (t3 - t4)) / 2,
+ * with an error of at most half of the round-trip time (t4 - t1) - (t3 - t2).
+ */
+struct ClockSample {
+  int64_t offset_; /**< Clock of the agent minus the clock of the coordinator */
+  int64_t delay_;  /**< Round-trip time of the exchange in nanoseconds */
+  int64_t time_;   /**< Time of the exchange on the clock of the coordinator */
+
+  ClockSample();
+};
+
+/**
+ * Class to convert the times of an agent to the clock of the coordinator,
+ * assuming that the offset of the agent changes linearly between the
+ * estimates at the start and at the end of a test.
+ */
+class ClockModel {
+private:
+  ClockSample start_; /**< Estimate before the test */
+  ClockSample end_;   /**< Estimate after the test */
+
+public:
+  /**
+   * Constructor.
+   * @param start estimate before the test
+   * @param end estimate after the test
+   */
+  ClockModel(const ClockSample &start, const ClockSample &end);
+
+  /**
+   * Calculates the rate of change of the offset.
+   * @return the skew of the clock of the agent, 1e-6 being 1 ppm
+   */
+  double skew() const;
+
+  /**
+   * Calculates the largest error of the estimates.
+   * @return the error in nanoseconds
+   */
+  int64_t error() const;
+
+  /**
+   * Getter for the offset at the start of the test.
+   * @return the offset in nanoseconds
+   */
+  int64_t offset() const;
+
+  /**
+   * Converts a time of the agent to the clock of the coordinator.
+   * @param time nanoseconds since the epoch of the clock of the agent
+   * @return the same time on the clock of the coordinator
+   */
+  std::chrono::high_resolution_clock::time_point local(int64_t time) const;
+};
+
+/**
+ * Class to represent one message of the control protocol.
+ * A message is a 64-bit length followed by the type and the fields, every
+ * integer in network byte order. Times of a tester are sent relative to its
+ * start time on the clock of the agent.
+ */
+class ControlMessage {
+public:
+  /**
+   * Enum for the type of the message
+   */
+  enum class Type : uint8_t {
+    Setup,   /**< Parameters of the test, to the agent */
+    Results, /**< Finished testers, to the coordinator */
+    Error,   /**< Reason of a failed test, to the coordinator */
+    TimeRequest, /**< Time of the coordinator, to the agent */
+    TimeReply,   /**< Times of the agent, to the coordinator */
+    Ready,       /**< End of the setup, to the coordinator */
+    Start        /**< Start time of the test, to the agent */
+  };
+
+private:
+  std::vector<uint8_t> data_; /**< Fields of the message */
+  size_t pos_;                /**< Position of the next field to get */
+
+  /**
+   * Checks whether the next field is in the message.
+   * @param len length of the field
+   */
+  void check(size_t len) const;
+
+public:
+  /**
+   * Constructor.
+   * @param type the type of the message
+   */
+  ControlMessage(Type type = Type::Error);
+
+  /**
+   * Getter for the type of the message.
+   * @return the type
+   */
+  Type type() const;
+
+  /**
+   * Appends a field.
+   * @param value the value of the field
+   */
+  void put8(uint8_t value);
+  void put32(uint32_t value);
+  void put64(uint64_t value);
+  void put_double(double value);
+  void put_string(const std::string &value);
+  void put(const Histogram &histogram);
+  void put(const TestSetup &setup);
+
+  /**
+   * Appends the connection statistics of a tester.
+   * @param stats the statistics
+   * @param base the start time of the tester
+   */
+  void put(const TransportStats &stats,
+           std::chrono::high_resolution_clock::time_point base);
+
+  /**
+   * Appends the results of a finished tester.
+   * @param tester the tester
+   */
+  void put(const DnsTester &tester);
+
+  /**
+   * Reads the next field, throws ControlException if the message is short.
+   * @return the value of the field
+   */
+  uint8_t get8();
+  uint32_t get32();
+  uint64_t get64();
+  double get_double();
+  std::string get_string();
+  void get(Histogram &histogram);
+  void get(TestSetup &setup);
+
+  /**
+   * Reads the connection statistics of a tester.
+   * @param stats the statistics to fill
+   * @param clock the clock of the agent
+   * @param base the start time of the tester on the clock of the agent
+   */
+  void get(TransportStats &stats, const ClockModel &clock, int64_t base);
+
+  /**
+   * Reads a tester sent by an agent.
+   * @param clock the clock of the agent
+   * @param reference_time start time of the tester with id 0 on the clock of
+   * the agent
+   * @return the tester
+   */
+  std::unique_ptr<DnsTester> get_tester(const ClockModel &clock,
+                                        int64_t reference_time);
+
+  /**
+   * Sends the message.
+   * @param fd the connection
+   */
+  void send(int fd) const;
+
+  /**
+   * Receives a message, replacing this one.
+   * @param fd the connection
+   * @return false if the connection was closed before the message
+   */
+  bool receive(int fd);
+};
+
+/**
+ * Class to run a test on agents and collect the results.
+ * Every agent runs the number of threads given on the command line, on
+ * disjoint parts of the names, as if they all were testers of one process.
+ */
+class Coordinator {
+private:
+  std::vector<Socket> agents_; /**< Connections to the agents */
+
+  /**
+   * Estimates the clock of an agent, keeping the exchange with the
+   * shortest round-trip time.
+   * @param agent index of the agent
+   * @return the estimate
+   */
+  ClockSample synchronize(size_t agent);
+
+  /**
+   * Receives a message of an agent, throws ControlException if it is of
+   * another type, with the reason of the failure for an Error.
+   * @param agent index of the agent
+   * @param message the message to receive into
+   * @param type the expected type
+   */
+  void expect(size_t agent, ControlMessage &message,
+              ControlMessage::Type type);
+
+public:
+  /**
+   * Constructor, connects to the agents.
+   * @param agents addresses of the agents
+   */
+  Coordinator(const std::vector<struct sockaddr_in> &agents);
+
+  /**
+   * Runs a test on the agents.
+   * @param setup the parameters of the test
+   * @return the testers of every agent
+   */
+  std::vector<std::unique_ptr<DnsTester>> run(const TestSetup &setup);
+};
+
+/**
+ * Class to run the tests of a coordinator, one after the other.
+ */
+class Agent {
+private:
+  Socket sock_;           /**< Listening socket */
+  std::vector<int> cpus_; /**< CPUs of the threads, or empty */
+  TestSetup previous_;    /**< Setup of the previous test of the coordinator */
+  std::vector<std::unique_ptr<Transport>>
+      transports_; /**< Transports of the previous test of the coordinator */
+
+  /**
+   * Runs a test and sends back the results.
+   * @param fd the connection to the coordinator
+   * @param message the setup of the test
+   */
+  void test(int fd, ControlMessage &message);
+
+public:
+  /**
+   * Constructor, starts listening.
+   * @param port the port to listen on
+   * @param cpus CPUs of the threads of the testers, or empty
+   */
+  Agent(uint16_t port, const std::vector<int> &cpus);
+
+  /**
+   * Serves the coordinators, never returns.
+   */
+  void serve();
+};
+
+#endif
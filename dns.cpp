@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <arpa/inet.h>
 #include <net/if.h>
+#include <stdexcept>
 #include <sys/types.h>
 
 #include <syslog.h>
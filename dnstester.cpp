@@ -20,7 +20,13 @@
  */
 
 #include "dnstester.h"
+#include "affinity.h"
+#include "doh_transport.h"
+#include "dot_transport.h"
 #include "spin_sleep.hpp"
+#include "tc_retry_transport.h"
+#include "tcp_transport.h"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cmath>
 #include <cstdio>
@@ -40,59 +46,193 @@ TestException::TestException(std::string what) : what_{what} {}
 const char *TestException::what() const noexcept { return what_.c_str(); }
 
 DnsQuery::DnsQuery()
-    : received_{false}, answered_{false}, rtt_{std::chrono::nanoseconds{-1}} {}
+    : received_{false}, answered_{false}, rtt_{std::chrono::nanoseconds{-1}},
+      retries_{0}, timed_out_{false} {}
+
+TesterOptions::TesterOptions()
+    : transport_{TransportType::UDP}, tls_sessions_{1}, tls_resumption_{true},
+      h2_streams_{100}, doh_path_{"/dns-query"}, tcp_fastopen_{false},
+      tc_retry_{false}, retries_{0}, retry_interval_{std::chrono::seconds{1}},
+      retry_backoff_{2.0}, epoch_label_{false}, first_epoch_{0},
+      duration_{0}, warmup_queries_{0}, warmup_duration_{0}, concurrency_{0},
+      slo_latency_{0}, slo_loss_{0}, pace_{false}, txtime_clock_{-1},
+      perf_counters_{false} {}
+
+QueryRange::QueryRange(const ChunkedStore<DnsQuery> &store, uint64_t first)
+    : store_(store), first_{first} {}
+
+ChunkedStore<DnsQuery>::const_iterator QueryRange::begin() const {
+  return ChunkedStore<DnsQuery>::const_iterator{&store_, first_};
+}
+
+ChunkedStore<DnsQuery>::const_iterator QueryRange::end() const {
+  return store_.end();
+}
+
+uint64_t QueryRange::size() const { return store_.size() - first_; }
+
+DnsTester::DnsTester()
+    : ip_{0}, netmask_{32}, num_req_{0}, num_burst_{0}, num_thread_{0},
+      thread_id_{0}, num_offset_{0}, stride_{1}, epoch_label_{false},
+      first_epoch_{0}, burst_delay_{0}, duration_{0}, reused_{false},
+      num_sent_{0},
+      sending_done_{true}, num_bursts_{0}, num_ticks_{0}, retries_{0},
+      retry_interval_{0}, retry_backoff_{1.0}, num_scheduled_{0},
+      num_resolved_{0}, num_duplicate_{0}, num_late_{0}, finished_early_{false},
+      tail_wait_{0}, setup_time_{0}, num_warmup_{0}, warmup_time_{0},
+      concurrency_{0}, rate_control_{false}, next_delay_{0}, window_lost_{0},
+      pace_gap_{0}, txtime_{false}, launch_delay_{0}, perf_counters_{false} {
+  memset(&server_, 0x00, sizeof(server_));
+  memset(&timeout_, 0x00, sizeof(timeout_));
+}
 
 DnsTester::DnsTester(
     struct in_addr server_addr, uint16_t port, uint32_t ip, uint8_t netmask,
-    uint32_t num_req, uint32_t num_burst, uint32_t num_thread,
-    uint32_t thread_id,
-    const std::chrono::time_point<std::chrono::high_resolution_clock>
-        &test_start_time,
-    std::chrono::nanoseconds burst_delay, struct timeval timeout)
+    uint64_t num_req, uint32_t num_burst, uint32_t num_thread,
+    uint32_t thread_id, std::chrono::nanoseconds burst_delay, struct timeval timeout,
+    const TesterOptions &options, std::unique_ptr<Transport> transport)
     : ip_{ip}, netmask_{netmask}, num_req_{num_req / num_thread},
       num_burst_{num_burst}, num_thread_{num_thread}, thread_id_{thread_id},
-      test_start_time_{test_start_time}, burst_delay_{burst_delay}, num_sent_{
-                                                                        0} {
+      epoch_label_{options.epoch_label_}, first_epoch_{options.first_epoch_},
+      burst_delay_{burst_delay}, duration_{options.duration_},
+      transport_{std::move(transport)}, reused_{!!transport_},
+      num_sent_{0}, sending_done_{false}, num_bursts_{0}, num_ticks_{0}, retries_{options.retries_},
+      retry_interval_{options.retry_interval_},
+      retry_backoff_{options.retry_backoff_},
+      wheel_{new TimerWheel{}}, num_scheduled_{0}, num_resolved_{0},
+      num_duplicate_{0}, num_late_{0}, finished_early_{false},
+      tail_wait_{0}, concurrency_{options.concurrency_},
+      rate_control_{options.slo_latency_.count() > 0}, next_delay_{0},
+      window_lost_{0}, pace_gap_{options.pace_ ? burst_delay / num_burst
+                                               : std::chrono::nanoseconds{0}},
+      txtime_{options.txtime_clock_ >= 0}, launch_delay_{burst_delay},
+      perf_counters_{options.perf_counters_} {
+  auto setup_start = std::chrono::high_resolution_clock::now();
   /* Set timeout */
   timeout_ = timeout;
-  /* Calculate offset */
-  num_offset_ = thread_id_ * num_req_;
+  /* The receiver has to wake up for every tick of the timer wheel */
+  struct timeval receive_timeout;
+  receive_timeout.tv_sec = 0;
+  receive_timeout.tv_usec =
+      std::chrono::duration_cast<std::chrono::microseconds>(TIMER_TICK)
+          .count();
+  /* Calculate offset, the first testers send the remainder */
+  uint64_t remainder = num_req % num_thread_;
+  num_req_ += thread_id_ < remainder ? 1 : 0;
+  /* The warm-up queries are sent first, at the same rate */
+  uint64_t warmup_offset;
+  if (options.warmup_duration_.count() > 0 && concurrency_ > 0) {
+    /* The number of queries of a closed loop is only known when sending */
+    if (duration_.count() == 0) {
+      throw TestException{"A warm-up time in the closed-loop mode requires a "
+                          "duration, give the number of warm-up queries "
+                          "instead."};
+    }
+    num_warmup_ = 0;
+    warmup_offset = 0;
+  } else if (options.warmup_duration_.count() > 0) {
+    /* Every tester sends a burst at every tick of the warm-up */
+    auto delay = std::max(burst_delay_, std::chrono::nanoseconds{1});
+    num_warmup_ = (uint64_t)((options.warmup_duration_ + delay -
+                              std::chrono::nanoseconds{1}) /
+                             delay) *
+                  num_burst_;
+    warmup_offset = thread_id_ * num_warmup_;
+  } else {
+    uint64_t warmup_remainder = options.warmup_queries_ % num_thread_;
+    num_warmup_ = options.warmup_queries_ / num_thread_ +
+                  (thread_id_ < warmup_remainder ? 1 : 0);
+    warmup_offset = thread_id_ * (options.warmup_queries_ / num_thread_) +
+                    std::min((uint64_t)thread_id_, warmup_remainder);
+  }
+  if (concurrency_ > 0) {
+    warmup_time_ = options.warmup_duration_;
+  } else {
+    warmup_time_ =
+        burst_delay_ * (int64_t)((num_warmup_ + num_burst_ - 1) / num_burst_);
+  }
+  if (duration_.count() > 0) {
+    /* The length of the test is unknown, so the testers take turns */
+    num_offset_ = thread_id_;
+    stride_ = num_thread_;
+  } else {
+    num_offset_ = thread_id_ * (num_req / num_thread_) +
+                  std::min((uint64_t)thread_id_, remainder) + warmup_offset;
+    stride_ = 1;
+    num_req_ += num_warmup_;
+    if (!epoch_label_ &&
+        num_offset_ + num_req_ > ((uint64_t)1 << (32 - netmask_))) {
+      throw TestException{"The warm-up and the requests are more than the "
+                          "avaliable IPs in the subnet, use --epoch for more "
+                          "names."};
+    }
+  }
+  /* The query store of a tester is limited */
+  if (duration_.count() > 0) {
+    /* A tester sending as fast as it can stops at the limit */
+    num_req_ = std::min(num_req_, MAX_ELEMENTS);
+    if (concurrency_ == 0 && burst_delay_.count() > 0 &&
+        num_req_ == MAX_ELEMENTS &&
+        (uint64_t)((warmup_time_ + duration_ + burst_delay_ -
+                    std::chrono::nanoseconds{1}) /
+                   burst_delay_) >
+            MAX_ELEMENTS / num_burst_) {
+      throw TestException{"The duration at this rate needs more than 2^32 "
+                          "queries per thread, use more threads."};
+    }
+  } else if (num_req_ > MAX_ELEMENTS) {
+    throw TestException{"The warm-up and the requests are more than 2^32 "
+                        "queries per thread, use more threads."};
+  }
   /* Fill server sockaddr structure */
   memset(&server_, 0x00, sizeof(server_));
   server_.sin_family = AF_INET;
   server_.sin_addr = server_addr;
   server_.sin_port = htons(port);
-  /* Create socket */
-  int sockfd;
-  if ((sockfd = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
-    std::stringstream ss;
-    ss << "Cannot create socket: " << strerror(errno);
-    throw TestException{ss.str()};
-  }
-  sock_ = Socket{sockfd};
-  /* Bind socket */
-  struct sockaddr_in local_addr;
-  memset(&local_addr, 0x00, sizeof(local_addr));
-  local_addr.sin_family = AF_INET;  // IPv6
-  local_addr.sin_addr.s_addr = htonl (INADDR_ANY); // To any valid IP address
-  local_addr.sin_port = htons(0);    // Get a random port
-  if (::bind(sock_, reinterpret_cast<struct sockaddr *>(&local_addr),
-             sizeof(local_addr)) == -1) {
-    std::stringstream ss;
-    ss << "Unable to bind socket: " << strerror(errno);
-    throw TestException{ss.str()};
-  }
-  /* Set socket timeout */
-  if (::setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO,
-                   reinterpret_cast<const void *>(&timeout_),
-                   sizeof(timeout_))) {
-    throw TestException("Cannot set timeout: setsockopt failed");
+  /* Create transport, unless the tester of the previous phase hands its
+   * connections over */
+  std::chrono::nanoseconds query_timeout =
+      std::chrono::seconds{timeout_.tv_sec} +
+      std::chrono::microseconds{timeout_.tv_usec};
+  if (reused_) {
+    /* Discard the answers to the previous phase received meanwhile */
+    uint8_t answer_data[DNS_MAX_LEN];
+    while (transport_->receive(answer_data, sizeof(answer_data)) > 0) {
+    }
+    transport_->reset_stats();
+  } else {
+    switch (options.transport_) {
+    case TransportType::UDP:
+      if (options.tc_retry_) {
+        transport_ = std::unique_ptr<Transport>{
+            new TcRetryTransport{server_, receive_timeout, query_timeout,
+                                 options.txtime_clock_}};
+      } else {
+        transport_ = std::unique_ptr<Transport>{
+            new UdpTransport{server_, receive_timeout, options.txtime_clock_}};
+      }
+      break;
+    case TransportType::TCP:
+      transport_ = std::unique_ptr<Transport>{new TcpTransport{
+          server_, receive_timeout, options.tcp_fastopen_, query_timeout}};
+      break;
+    case TransportType::DoT:
+      transport_ = std::unique_ptr<Transport>{
+          new DotTransport{server_, receive_timeout, options.tls_sessions_,
+                           options.tls_resumption_}};
+      break;
+    case TransportType::DoH:
+      transport_ = std::unique_ptr<Transport>{new DohTransport{
+          server_, receive_timeout, options.tls_sessions_, options.h2_streams_,
+          options.doh_path_, options.tls_resumption_, query_timeout}};
+      break;
+    }
   }
-  /* Preallocate the test queries */
-  tests_.reserve(num_req_);
-  /* Create the test queries */
-  for (uint32_t i = 0; i < num_req_; i++) {
-    tests_.push_back(DnsQuery{});
+  /* Preallocate the test queries, a duration-based test grows on the go */
+  if (duration_.count() == 0) {
+    tests_.resize(num_req_);
+  } else {
+    tests_.reserve(std::min(num_req_, (uint64_t)1 << CHUNK_BITS));
   }
   /* Creating the base query */
   memset(query_data_, 0x00, sizeof(query_data_));
@@ -113,10 +253,8 @@ DnsTester::DnsTester(
   /* Creating the question*/
   uint8_t *question = query_data_ + sizeof(DNSHeader);
   /* Creating the domain name */
-  char addr[64];
   char query_addr[512];
-  snprintf(addr, sizeof(addr), dns64_addr_format_string, 0, 0, 0, 0);
-  snprintf(query_addr, sizeof(query_addr), "%s.%s.", addr, dns64_addr_domain);
+  name(0, query_addr, sizeof(query_addr));
   /* Convering the domain name to DNS Name format */
   char *label = strtok(query_addr, ".");
   while (label != nullptr) {
@@ -137,85 +275,310 @@ DnsTester::DnsTester(
   size_t len = (size_t)(question - query_data_);
   query_ = std::unique_ptr<DNSPacket>{
       new DNSPacket{query_data_, len, sizeof(query_data_)}};
+  /* Creating the retransmissions */
+  if (retries_ > 0) {
+    memcpy(retry_data_, query_data_, sizeof(retry_data_));
+    retry_ = std::unique_ptr<DNSPacket>{
+        new DNSPacket{retry_data_, len, sizeof(retry_data_)}};
+  }
+  setup_time_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::high_resolution_clock::now() - setup_start);
 }
 
-void DnsTester::test() {
-  for (uint32_t i = 0; i < num_burst_; i++) {
-    /* Get query store */
-    DnsQuery &query = tests_[num_sent_];
-    /* Modify the base query */
-    /* Modify the label */
-    char label[64];
-    uint32_t ip = ip_ | (num_sent_ + num_offset_);
-    snprintf(label, sizeof(label), dns64_addr_format_string, (ip >> 24) & 0xff,
-             (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
-    memcpy(query_->labels_[0].begin_ + 1, label, strlen(label));
-    /* Modify the Transaction ID */
-    query_->header_->id((num_sent_ + num_offset_) % (1 << 16));
+QueryRange DnsTester::measured() const {
+  return QueryRange{tests_, std::min(num_warmup_, tests_.size())};
+}
+
+void DnsTester::prepare(DNSPacket &packet, uint64_t n) {
+  uint64_t index = num_offset_ + n * stride_;
+  uint64_t subnet_size = (uint64_t)1 << (32 - netmask_);
+  /* Modify the label */
+  char label[64];
+  uint32_t ip = ip_ | (index % subnet_size);
+  snprintf(label, sizeof(label), dns64_addr_format_string, (ip >> 24) & 0xff,
+           (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+  memcpy(packet.labels_[0].begin_ + 1, label, strlen(label));
+  /* Modify the epoch label */
+  if (epoch_label_) {
+    snprintf(label, sizeof(label), dns64_epoch_format_string,
+             first_epoch_ + index / subnet_size);
+    memcpy(packet.labels_[1].begin_ + 1, label, strlen(label));
+  }
+  /* Modify the Transaction ID */
+  packet.header_->id(index % (1 << 16));
+}
+
+void DnsTester::name(uint64_t n, char *buffer, size_t len) const {
+  uint64_t index = num_offset_ + n * stride_;
+  uint64_t subnet_size = (uint64_t)1 << (32 - netmask_);
+  char addr[64];
+  uint32_t ip = ip_ | (index % subnet_size);
+  snprintf(addr, sizeof(addr), dns64_addr_format_string, (ip >> 24) & 0xff,
+           (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+  if (epoch_label_) {
+    char epoch[64];
+    snprintf(epoch, sizeof(epoch), dns64_epoch_format_string,
+             first_epoch_ + index / subnet_size);
+    snprintf(buffer, len, "%s.%s.%s.", addr, epoch, dns64_addr_domain);
+  } else {
+    snprintf(buffer, len, "%s.%s.", addr, dns64_addr_domain);
+  }
+}
+
+uint64_t DnsTester::tick(
+    std::chrono::high_resolution_clock::time_point time) const {
+  if (time <= test_start_time_) {
+    return 0;
+  }
+  /* Round up, so that a timer never expires early */
+  return (time - test_start_time_ + TIMER_TICK - std::chrono::nanoseconds{1}) /
+         TIMER_TICK;
+}
+
+void DnsTester::send(std::chrono::high_resolution_clock::time_point launch) {
+  /* Get query store */
+  if (num_sent_ >= tests_.capacity()) {
+    tests_.reserve(num_sent_ + 1);
+  }
+  DnsQuery &query = tests_[num_sent_];
+  /* Modify the base query */
+  prepare(*query_, num_sent_);
+  if (launch.time_since_epoch().count() != 0) {
+    /* The kernel transmits the query at its launch time */
+    query.time_sent_ = launch;
+    transport_->send_at(query_->begin_, query_->len_, launch);
+  } else {
+    /* Store the time before the answer can arrive */
+    query.time_sent_ = std::chrono::high_resolution_clock::now();
     /* Send the query */
-    if (::sendto(sock_, reinterpret_cast<const void *>(query_->begin_),
-                 query_->len_, 0,
-                 reinterpret_cast<const struct sockaddr *>(&server_),
-                 sizeof(server_)) != query_->len_) {
-      std::cerr << "Can't send packet." << std::endl;
+    transport_->send(query_->begin_, query_->len_);
+  }
+  m_.lock();
+  num_sent_++;
+  m_.unlock();
+}
+
+void DnsTester::test() {
+  auto now = std::chrono::high_resolution_clock::now();
+  num_ticks_++;
+  slip_.add(std::max(
+      (int64_t)0, (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      now - timer_->scheduled())
+                      .count()));
+  /* With txtime the timer ticks ahead, the burst is sent at its launch time */
+  auto launch = next_launch_;
+  if (txtime_) {
+    now = launch;
+    next_launch_ += launch_delay_;
+  }
+  /* A duration-based test skips the bursts it could not send in time */
+  if (!sending_done_ && (duration_.count() == 0 || now < test_end_time_)) {
+    for (uint32_t i = 0; i < num_burst_ && num_sent_ < num_req_; i++) {
+      if (txtime_) {
+        /* The kernel spaces the paced queries, the sender works ahead */
+        send(launch + i * pace_gap_);
+        continue;
+      }
+      /* Paced queries are spread evenly over the interval of the burst */
+      if (i > 0 && pace_gap_.count() > 0) {
+        spinsleep::sleep_until(now + i * pace_gap_);
+      }
+      send();
     }
-    /* Store the time */
-    query.time_sent_ = std::chrono::high_resolution_clock::now();
+  }
+  if (!sending_done_ &&
+      (num_sent_ == num_req_ || num_ticks_ == num_bursts_ ||
+       (duration_.count() > 0 && now >= test_end_time_))) {
+    m_.lock();
+    sending_done_ = true;
+    m_.unlock();
+  }
+  /* A new rate of the rate controller, for the remaining queries or time */
+  std::chrono::nanoseconds burst_delay{next_delay_.exchange(0)};
+  if (!sending_done_ && burst_delay.count() > 0) {
+    size_t n;
+    if (duration_.count() > 0) {
+      n = (size_t)((test_end_time_ - now + burst_delay -
+                    std::chrono::nanoseconds{1}) /
+                   burst_delay);
+    } else {
+      n = (size_t)((num_req_ - num_sent_ + num_burst_ - 1) / num_burst_);
+    }
+    num_bursts_ = num_ticks_ + n;
+    timer_->reschedule(burst_delay, n);
+    if (pace_gap_.count() > 0) {
+      pace_gap_ = burst_delay / num_burst_;
+    }
+    next_launch_ = launch + burst_delay;
+    launch_delay_ = burst_delay;
+  }
+}
+
+void DnsTester::refill() {
+  if (sending_done_) {
+    return;
+  }
+  auto now = std::chrono::high_resolution_clock::now();
+  bool warm = num_sent_ >= num_warmup_;
+  while (num_sent_ < num_req_ && outstanding() < concurrency_) {
+    if (warmup_time_.count() == 0 && num_warmup_ > 0 &&
+        num_sent_ == num_warmup_) {
+      /* The duration is measured from the end of the warm-up */
+      test_end_time_ = now + duration_;
+      warm = true;
+    }
+    if (duration_.count() > 0 && warm && now >= test_end_time_) {
+      break;
+    }
+    if (now < test_start_time_ + warmup_time_) {
+      num_warmup_ = num_sent_ + 1;
+    }
+    send();
+  }
+  if (num_sent_ == num_req_ ||
+      (duration_.count() > 0 && warm && now >= test_end_time_)) {
     m_.lock();
-    num_sent_++;
+    sending_done_ = true;
     m_.unlock();
   }
 }
 
-void DnsTester::start() {
+void DnsTester::track() {
+  auto now = std::chrono::high_resolution_clock::now();
+  auto timeout = std::chrono::seconds{timeout_.tv_sec} +
+                 std::chrono::microseconds{timeout_.tv_usec};
+  /* Put the newly sent queries on the wheel */
+  m_.lock();
+  uint64_t num_sent = num_sent_;
+  m_.unlock();
+  /* Allocate the queries of a duration-based test ahead of the sender */
+  if (duration_.count() > 0 &&
+      tests_.capacity() - num_sent < ((uint64_t)1 << CHUNK_BITS) / 2 &&
+      tests_.capacity() < num_req_) {
+    tests_.reserve(tests_.capacity() + 1);
+  }
+  for (; num_scheduled_ < num_sent; num_scheduled_++) {
+    const DnsQuery &query = tests_[num_scheduled_];
+    if (retries_ > 0 && retry_interval_ < timeout) {
+      wheel_->schedule(num_scheduled_,
+                       tick(query.time_sent_ + retry_interval_));
+    } else {
+      wheel_->schedule(num_scheduled_, tick(query.time_sent_ + timeout));
+    }
+  }
+  /* Every query has one timer, for its next retransmission or timeout */
+  wheel_->advance(tick(now), [&](uint64_t index) {
+    DnsQuery &query = tests_[index];
+    if (query.received_ || query.timed_out_) {
+      return;
+    }
+    uint64_t deadline = tick(query.time_sent_ + timeout);
+    if (wheel_->now() >= deadline) {
+      query.timed_out_ = true;
+      num_resolved_++;
+      if (rate_control_ && index >= num_warmup_) {
+        std::lock_guard<std::mutex> lock{window_m_};
+        window_lost_++;
+      }
+      return;
+    }
+    prepare(*retry_, index);
+    transport_->send(retry_->begin_, retry_->len_);
+    query.retries_++;
+    uint64_t next = deadline;
+    if (query.retries_ < retries_) {
+      auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          retry_interval_ * pow(retry_backoff_, query.retries_));
+      next = std::min(next, tick(now + delay));
+    }
+    wheel_->schedule(index, next);
+  });
+}
+
+void DnsTester::start(
+    const std::chrono::time_point<std::chrono::high_resolution_clock>
+        &test_start_time,
+    int sender_cpu) {
+  test_start_time_ = test_start_time;
+  test_end_time_ = test_start_time + warmup_time_ + duration_;
+  next_launch_ = test_start_time;
   /* Starting test packet sending */
-  timer_ = std::unique_ptr<Timer>{
-      new Timer{"Sender " + std::to_string(thread_id_),
-                [&]() { spinsleep::sleep_until(test_start_time_); },
-                std::bind(&DnsTester::test, this), burst_delay_,
-                (size_t)(num_req_ / num_burst_)}};
-  timer_->start();
+  /* The last burst may be partial, and a tester without queries still ticks
+   * once to finish */
+  num_bursts_ = std::max((size_t)1, (size_t)((num_req_ + num_burst_ - 1) /
+                                             num_burst_));
+  if (duration_.count() > 0 && concurrency_ == 0) {
+    /* A delay of 0 sends the bursts as fast as the timer can, a closed loop
+     * has no bursts */
+    auto delay = std::max(burst_delay_, std::chrono::nanoseconds{1});
+    num_bursts_ = (size_t)((warmup_time_ + duration_ + delay -
+                            std::chrono::nanoseconds{1}) /
+                           delay);
+  }
+  if (concurrency_ > 0) {
+    /* The receiver sends the queries itself in the closed-loop mode */
+    spinsleep::sleep_until(test_start_time_);
+  } else {
+    timer_ = std::unique_ptr<Timer>{
+        new Timer{"Sender " + std::to_string(thread_id_),
+                  [&, sender_cpu]() {
+                    affinity::pin(sender_cpu);
+                    if (perf_counters_) {
+                      sender_counters_.reset(new PerfCounters{});
+                    }
+                    spinsleep::sleep_until(
+                        txtime_ ? test_start_time_ - TXTIME_LEAD
+                                : test_start_time_);
+                    /* The wait for the start is not counted */
+                    if (sender_counters_) {
+                      sender_counters_->start();
+                    }
+                  },
+                  std::bind(&DnsTester::test, this), burst_delay_,
+                  num_bursts_}};
+    timer_->start();
+  }
+  std::unique_ptr<PerfCounters> receiver_counters;
+  if (perf_counters_) {
+    receiver_counters.reset(new PerfCounters{});
+    receiver_counters->start();
+  }
   /* Receiving answers */
-  struct sockaddr_in sender;
-  socklen_t sender_len;
   ssize_t recvlen;
-  uint8_t answer_data[UDP_MAX_LEN];
+  uint8_t answer_data[DNS_MAX_LEN];
   bool continue_receiving;
   std::chrono::time_point<std::chrono::high_resolution_clock> receive_until;
+  std::chrono::time_point<std::chrono::high_resolution_clock> sent_all;
 
   continue_receiving = true;
   while (continue_receiving ||
-         std::chrono::high_resolution_clock::now() <= receive_until) {
+         (std::chrono::high_resolution_clock::now() <= receive_until &&
+          outstanding() > 0)) {
+    if (concurrency_ > 0) {
+      refill();
+    }
     m_.lock();
-    size_t remaining = num_req_ - num_sent_;
+    bool sending_done = sending_done_;
     m_.unlock();
-    if (remaining == 0) {
+    if (continue_receiving && sending_done) {
       continue_receiving = false;
-      receive_until = std::chrono::high_resolution_clock::now() +
+      sent_all = std::chrono::high_resolution_clock::now();
+      /* Normally ends earlier, when every query is answered or timed out */
+      receive_until = sent_all +
                       std::chrono::seconds{timeout_.tv_sec} +
-                      std::chrono::microseconds{timeout_.tv_usec};
+                      std::chrono::microseconds{timeout_.tv_usec} +
+                      2 * TIMER_TICK;
+      if (txtime_) {
+        /* The last queries are still waiting for their launch time */
+        receive_until += TXTIME_LEAD;
+      }
     }
-    memset(&sender, 0x00, sizeof(sender));
-    sender_len = sizeof(sender);
-    if ((recvlen = ::recvfrom(sock_, answer_data, sizeof(answer_data), 0,
-                              reinterpret_cast<struct sockaddr *>(&sender),
-                              &sender_len)) > 0) {
+    track();
+    if ((recvlen = transport_->receive(answer_data, sizeof(answer_data))) >
+        0) {
       /* Get the time of the receipt */
       std::chrono::high_resolution_clock::time_point time_received =
           std::chrono::high_resolution_clock::now();
-      /* Test whether the answer came from the DUT */
-      if (memcmp(reinterpret_cast<const void *>(&sender.sin_addr),
-                 reinterpret_cast<const void *>(&server_.sin_addr),
-                 sizeof(struct in_addr)) != 0 ||
-          sender.sin_port != server_.sin_port) {
-        char sender_text[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, reinterpret_cast<const void *>(&sender.sin_addr),
-                  sender_text, sizeof(sender_text));
-        std::stringstream ss;
-        ss << "Received packet from other host than the DUT: [" << sender_text
-           << "]:" << ntohs(sender.sin_port);
-        throw TestException{ss.str()};
-      }
       /* Parse the answer */
       DNSPacket answer{answer_data, (size_t)recvlen, sizeof(answer_data)};
       /* Test whether the query is valid */
@@ -235,13 +598,68 @@ void DnsTester::start() {
         throw TestException{"Invalid question."};
       }
       ip = (temp[0] << 24) | (temp[1] << 16) | (temp[2] << 8) | temp[3];
-      auto fqdn = ip & (((uint64_t)1 << (32 - netmask_)) - 1);
-      if (fqdn < num_offset_) {
-        throw TestException{"Unexpected FQDN in question: too small."};
-      } else if (fqdn >= (num_offset_ + num_req_)) {
-        throw TestException{"Unexpected FQDN in question: too large."};
+      uint64_t subnet_size = (uint64_t)1 << (32 - netmask_);
+      uint64_t fqdn = ip & (subnet_size - 1);
+      bool too_small = false;
+      if (epoch_label_) {
+        uint64_t epoch;
+        if (answer.labels_.size() < 2 ||
+            answer.labels_[1].length() >= sizeof(label)) {
+          throw TestException{"Invalid question."};
+        }
+        strncpy(label, (const char *)answer.labels_[1].begin_ + 1,
+                answer.labels_[1].length());
+        label[answer.labels_[1].length()] = '\0';
+        if (sscanf(label, dns64_epoch_format_string, &epoch) != 1) {
+          throw TestException{"Invalid question."};
+        }
+        too_small = epoch < first_epoch_;
+        fqdn += (epoch - first_epoch_) * subnet_size;
+      }
+      const char *unexpected = nullptr;
+      uint64_t n = 0;
+      if (too_small || fqdn < num_offset_) {
+        unexpected = "Unexpected FQDN in question: too small.";
+      } else if ((fqdn - num_offset_) % stride_ != 0) {
+        unexpected = "Unexpected FQDN in question: other tester.";
+      } else if ((n = (fqdn - num_offset_) / stride_) >= num_req_ ||
+                 n >= tests_.capacity()) {
+        unexpected = "Unexpected FQDN in question: too large.";
+      } else if (reused_ &&
+                 tests_[n].time_sent_.time_since_epoch().count() == 0) {
+        /* The send time is stored before sending */
+        unexpected = "Unexpected FQDN in question: not sent yet.";
+      }
+      if (unexpected != nullptr) {
+        /* A reused transport may receive late answers to the previous phase */
+        if (reused_) {
+          continue;
+        }
+        throw TestException{unexpected};
+      }
+      DnsQuery &query = tests_[n];
+      /* Only the first answer counts, the warm-up is not counted */
+      if (query.received_) {
+        if (n >= num_warmup_) {
+          num_duplicate_++;
+        }
+        continue;
+      }
+      /* Count the answers arriving after the timeout */
+      if (query.timed_out_) {
+        if (n >= num_warmup_) {
+          num_late_++;
+        }
+      } else {
+        num_resolved_++;
+        if (rate_control_ && n >= num_warmup_) {
+          std::lock_guard<std::mutex> lock{window_m_};
+          window_rtt_.add(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  time_received - query.time_sent_)
+                  .count());
+        }
       }
-      DnsQuery &query = tests_[fqdn - num_offset_];
       /* Set the received flag true */
       query.received_ = true;
       /* Set the received timestamp */
@@ -254,13 +672,37 @@ void DnsTester::start() {
       /* If the error is not caused by timeout, there is something wrong */
       if (errno != EWOULDBLOCK) {
         std::stringstream ss;
-        ss << "Error in recvfrom: " << strerror(errno);
+        ss << "Error in receive: " << strerror(errno);
         throw TestException{ss.str()};
       }
     }
   }
-  timer_->stop();
-  for (auto &query : tests_) {
+  if (timer_) {
+    timer_->stop();
+  }
+  /* The counters of the finished sender can still be read */
+  if (sender_counters_) {
+    sender_counts_ = sender_counters_->read();
+    sender_counters_.reset();
+  }
+  if (receiver_counters) {
+    receiver_counts_ = receiver_counters->read();
+  }
+  tail_wait_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::high_resolution_clock::now() - sent_all);
+  transport_stats_ = transport_->stats();
+  if (duration_.count() > 0 && num_sent_ == MAX_ELEMENTS) {
+    std::cerr << "Tester " << thread_id_
+              << " stopped sending at the limit of 2^32 queries." << std::endl;
+  }
+  /* Only the sent queries are part of the results */
+  tests_.resize(num_sent_);
+  finished_early_ = true;
+  for (uint64_t i = 0; i < tests_.size(); i++) {
+    DnsQuery &query = tests_[i];
+    if (query.timed_out_ || !query.received_) {
+      finished_early_ = false;
+    }
     /* Calculate the Round-Trip-Time */
     if (query.received_) {
       query.rtt_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
@@ -274,56 +716,474 @@ void DnsTester::start() {
   }
 }
 
+/**
+ * Prints the distribution of a histogram of nanosecond values.
+ * @param name name of the distribution
+ * @param histogram the histogram
+ */
+static void print_distribution(const char *name, const Histogram &histogram) {
+  printf("%s min/p50/p90/p99/max: %.02f/%.02f/%.02f/%.02f/%.02f ms\n", name,
+         histogram.min() / 1000000.0, histogram.percentile(50) / 1000000.0,
+         histogram.percentile(90) / 1000000.0,
+         histogram.percentile(99) / 1000000.0, histogram.max() / 1000000.0);
+}
+
+/**
+ * Formats an event count per query, or n/a if it was not counted.
+ * @param buffer the buffer to write into
+ * @param len length of the buffer
+ * @param count the count, or -1
+ * @param queries the number of queries
+ * @return the buffer
+ */
+static const char *per_query(char *buffer, size_t len, int64_t count,
+                             uint64_t queries) {
+  if (count < 0 || queries == 0) {
+    snprintf(buffer, len, "n/a");
+  } else {
+    snprintf(buffer, len, "%.1f", (double)count / queries);
+  }
+  return buffer;
+}
+
+/**
+ * Formats an event count, or n/a if it was not counted.
+ * @param buffer the buffer to write into
+ * @param len length of the buffer
+ * @param count the count, or -1
+ * @return the buffer
+ */
+static const char *total(char *buffer, size_t len, int64_t count) {
+  if (count < 0) {
+    snprintf(buffer, len, "n/a");
+  } else {
+    snprintf(buffer, len, "%ld", count);
+  }
+  return buffer;
+}
+
+/**
+ * Prints the events of a thread of a tester.
+ * @param thread_id id of the tester
+ * @param thread name of the thread
+ * @param queries number of queries sent or answers received by the thread
+ * @param time time between the first and the last of them
+ * @param counts the events of the thread
+ */
+static void print_counts(uint32_t thread_id, const char *thread,
+                         uint64_t queries, std::chrono::nanoseconds time,
+                         const PerfCounts &counts) {
+  char cycles[32], ipc[32], misses[32], switches[32], faults[32];
+  if (counts.cycles_ > 0 && counts.instructions_ >= 0) {
+    snprintf(ipc, sizeof(ipc), "%.2f",
+             (double)counts.instructions_ / counts.cycles_);
+  } else {
+    snprintf(ipc, sizeof(ipc), "n/a");
+  }
+  printf("%6u %-8s %12.02f %12s %6s %12s %12s %12s\n", thread_id, thread,
+         time.count() > 0 ? queries * 1000000000.0 / time.count() : 0.0,
+         per_query(cycles, sizeof(cycles), counts.cycles_, queries), ipc,
+         per_query(misses, sizeof(misses), counts.cache_misses_, queries),
+         total(switches, sizeof(switches), counts.context_switches_),
+         total(faults, sizeof(faults), counts.page_faults_));
+}
+
+std::unique_ptr<Transport> DnsTester::release_transport() {
+  return std::move(transport_);
+}
+
+uint64_t DnsTester::outstanding() {
+  m_.lock();
+  uint64_t num_sent = num_sent_;
+  m_.unlock();
+  /* An answer can be processed before its sending is accounted */
+  uint64_t num_resolved = num_resolved_;
+  return num_sent > num_resolved ? num_sent - num_resolved : 0;
+}
+
+bool DnsTester::sending_done() {
+  std::lock_guard<std::mutex> lock{m_};
+  return sending_done_;
+}
+
+void DnsTester::reschedule(std::chrono::nanoseconds burst_delay) {
+  /* Applied by the sender, which owns the timer */
+  next_delay_ = std::max(burst_delay, std::chrono::nanoseconds{1}).count();
+}
+
+uint64_t DnsTester::window(Histogram &rtt) {
+  std::lock_guard<std::mutex> lock{window_m_};
+  rtt += window_rtt_;
+  window_rtt_.clear();
+  uint64_t lost = window_lost_;
+  window_lost_ = 0;
+  return lost;
+}
+
+DnsTesterAggregator::Summary::Summary()
+    : total_{0}, received_{0}, answered_{0}, timed_out_{0}, early_{0},
+      retransmissions_{0}, retransmitted_{0}, first_try_{0}, mean_{0},
+      m2_{0},
+      first_sent_{std::chrono::high_resolution_clock::time_point::max()},
+      last_sent_{std::chrono::high_resolution_clock::time_point::min()},
+      last_received_{std::chrono::high_resolution_clock::time_point::min()},
+      all_sent_{0}, all_received_{0}, all_sending_{0}, all_receiving_{0} {}
+
+DnsTesterAggregator::Summary &DnsTesterAggregator::Summary::
+operator+=(const Summary &rhs) {
+  /* Merge the averages and the squared differences of the round-trip times */
+  uint64_t received = received_ + rhs.received_;
+  if (received > 0) {
+    double delta = rhs.mean_ - mean_;
+    m2_ += rhs.m2_ + delta * delta * received_ * rhs.received_ / received;
+    mean_ += delta * rhs.received_ / received;
+  }
+  total_ += rhs.total_;
+  received_ = received;
+  answered_ += rhs.answered_;
+  timed_out_ += rhs.timed_out_;
+  early_ += rhs.early_;
+  retransmissions_ += rhs.retransmissions_;
+  retransmitted_ += rhs.retransmitted_;
+  first_try_ += rhs.first_try_;
+  rtt_ += rhs.rtt_;
+  gaps_ += rhs.gaps_;
+  first_sent_ = std::min(first_sent_, rhs.first_sent_);
+  last_sent_ = std::max(last_sent_, rhs.last_sent_);
+  last_received_ = std::max(last_received_, rhs.last_received_);
+  all_sent_ += rhs.all_sent_;
+  all_received_ += rhs.all_received_;
+  all_sending_ = std::max(all_sending_, rhs.all_sending_);
+  all_receiving_ = std::max(all_receiving_, rhs.all_receiving_);
+  return *this;
+}
+
+DnsTesterAggregator::Summary
+DnsTesterAggregator::summarize(const DnsTester &tester) {
+  Summary summary;
+  uint64_t first = std::min(tester.num_warmup_, tester.tests_.size());
+  uint64_t n = 0;
+  auto first_sent = std::chrono::high_resolution_clock::time_point::max();
+  auto last_sent = std::chrono::high_resolution_clock::time_point::min();
+  auto first_received = first_sent;
+  auto last_received = last_sent;
+  std::chrono::high_resolution_clock::time_point previous;
+  for (const auto &query : tester.tests_) {
+    /* The threads also handled the warm-up */
+    first_sent = std::min(first_sent, query.time_sent_);
+    last_sent = std::max(last_sent, query.time_sent_);
+    if (query.received_) {
+      first_received = std::min(first_received, query.time_received_);
+      last_received = std::max(last_received, query.time_received_);
+      summary.all_received_++;
+    }
+    if (n++ < first) {
+      continue;
+    }
+    /* The results do not */
+    summary.total_++;
+    if (query.received_) {
+      summary.received_++;
+      double rtt = query.rtt_.count();
+      double delta = rtt - summary.mean_;
+      summary.mean_ += delta / summary.received_;
+      summary.m2_ += delta * (rtt - summary.mean_);
+      summary.rtt_.add(std::max(query.rtt_.count(), (int64_t)0));
+      if (query.time_received_ < query.time_sent_) {
+        summary.early_++;
+      }
+      summary.last_received_ =
+          std::max(summary.last_received_, query.time_received_);
+    }
+    if (query.answered_) {
+      summary.answered_++;
+    }
+    if (query.timed_out_) {
+      summary.timed_out_++;
+    }
+    summary.retransmissions_ += query.retries_;
+    if (query.retries_ > 0) {
+      summary.retransmitted_++;
+    } else if (query.answered_) {
+      summary.first_try_++;
+    }
+    /* Time between the consecutive queries of the sender */
+    if (summary.total_ > 1 && query.time_sent_ >= previous) {
+      summary.gaps_.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            query.time_sent_ - previous)
+                            .count());
+    }
+    previous = query.time_sent_;
+    summary.first_sent_ = std::min(summary.first_sent_, query.time_sent_);
+    summary.last_sent_ = std::max(summary.last_sent_, query.time_sent_);
+  }
+  summary.all_sent_ = tester.tests_.size();
+  if (summary.all_sent_ > 1) {
+    summary.all_sending_ = last_sent - first_sent;
+  }
+  if (summary.all_received_ > 1) {
+    summary.all_receiving_ = last_received - first_received;
+  }
+  return summary;
+}
+
 DnsTesterAggregator::DnsTesterAggregator(
-    const std::vector<std::unique_ptr<DnsTester>> &dns_testers)
-    : dns_testers_(dns_testers) {}
+    const std::vector<std::unique_ptr<DnsTester>> &dns_testers,
+    bool per_tester)
+    : dns_testers_(dns_testers), per_tester_{per_tester} {}
 
 void DnsTesterAggregator::display() {
-  uint32_t num_received, num_answered, num_total;
-  double average, standard_deviation;
-  num_total = 0;
-  num_received = 0;
-  num_answered = 0;
-  /* Number of received and answered queries */
+  /* One pass over the queries of every tester, merged for the totals */
+  std::vector<Summary> summaries;
+  Summary totals;
   for (const auto &tester : dns_testers_) {
-    for (const auto &query : tester->tests_) {
-      num_total++;
-      if (query.received_) {
-        num_received++;
-      }
-      if (query.answered_) {
-        num_answered++;
+    summaries.push_back(summarize(*tester));
+    totals += summaries.back();
+  }
+  uint64_t num_total = totals.total_;
+  uint64_t num_received = totals.received_;
+  uint64_t num_answered = totals.answered_;
+  double average = totals.mean_;
+  double standard_deviation = sqrt(totals.m2_ / num_received);
+  /* Print results */
+  uint64_t num_warmup = totals.all_sent_ - num_total;
+  if (num_warmup > 0) {
+    printf("Warm-up queries (excluded from the results): %lu\n", num_warmup);
+  }
+  printf("Sent queries: %lu\n", num_total);
+  printf("Received answers: %lu (%.02f%%)\n", num_received,
+         ((double)num_received / num_total) * 100);
+  printf("Valid answers: %lu (%.02f%%)\n", num_answered,
+         ((double)num_answered / num_total) * 100);
+  printf("Average round-trip time: %.02f ms\n", average / 1000000.0);
+  printf("Standard deviation of the round-trip time: %.02f ms\n",
+         standard_deviation / 1000000.0);
+  /* Time between the consecutive queries of every sender */
+  if (totals.gaps_.count() > 0) {
+    /* With txtime the queries are stored with their launch time */
+    print_distribution(dns_testers_[0]->txtime_
+                           ? "Scheduled inter-packet gap of the testers"
+                           : "Inter-packet gap of the testers",
+                       totals.gaps_);
+  }
+  if (dns_testers_[0]->txtime_ && totals.early_ > 0) {
+    printf("Warning: %lu answers arrived before the launch time of their "
+           "query, the interface has no etf or fq qdisc to honor the launch "
+           "times\n",
+           totals.early_);
+  }
+  /* Throughput of the closed loop, from the first query to the last answer */
+  if (dns_testers_[0]->concurrency_ > 0 && num_received > 0) {
+    printf("Closed loop of %u outstanding queries per tester: %.02f "
+           "answers/s\n",
+           dns_testers_[0]->concurrency_,
+           num_received / std::chrono::duration<double>(totals.last_received_ -
+                                                        totals.first_sent_)
+                              .count());
+  }
+  /* Timeout statistics */
+  uint64_t num_timed_out = totals.timed_out_;
+  uint64_t num_late = 0;
+  for (const auto &tester : dns_testers_) {
+    num_late += tester->num_late_;
+  }
+  if (num_timed_out > 0 || num_late > 0) {
+    printf("Timed out queries: %lu (%.02f%%)\n", num_timed_out,
+           ((double)num_timed_out / num_total) * 100);
+    printf("Answers after the timeout: %lu\n", num_late);
+  }
+  /* Results of every tester, to show the imbalance between them */
+  if (per_tester_) {
+    printf("Results of the testers (times in ms):\n");
+    printf("%6s %12s %12s %12s %12s %8s %8s %9s %9s %8s\n", "Tester", "sent",
+           "received", "valid", "rate/s", "RTT p50", "RTT p99", "slip p99",
+           "slip max", "errors");
+    for (size_t i = 0; i < dns_testers_.size(); i++) {
+      const DnsTester &tester = *dns_testers_[i];
+      const Summary &summary = summaries[i];
+      double sending = std::chrono::duration<double>(summary.last_sent_ -
+                                                     summary.first_sent_)
+                           .count();
+      /* The closed-loop mode has no timer */
+      char slip_p99[32], slip_max[32];
+      if (tester.slip_.count() > 0) {
+        snprintf(slip_p99, sizeof(slip_p99), "%.02f",
+                 tester.slip_.percentile(99) / 1000000.0);
+        snprintf(slip_max, sizeof(slip_max), "%.02f",
+                 tester.slip_.max() / 1000000.0);
+      } else {
+        snprintf(slip_p99, sizeof(slip_p99), "n/a");
+        snprintf(slip_max, sizeof(slip_max), "n/a");
       }
+      printf("%6u %12lu %12lu %12lu %12.02f %8.02f %8.02f %9s %9s %8lu\n",
+             tester.thread_id_, summary.total_, summary.received_,
+             summary.answered_,
+             summary.total_ > 1 && sending > 0
+                 ? (summary.total_ - 1) / sending
+                 : 0,
+             summary.rtt_.percentile(50) / 1000000.0,
+             summary.rtt_.percentile(99) / 1000000.0, slip_p99, slip_max,
+             tester.transport_stats_.send_errors_);
     }
   }
-  /* Average */
-  average = 0;
+  /* How the wait for the last answers ended */
   for (const auto &tester : dns_testers_) {
-    for (const auto &query : tester->tests_) {
-      if (query.received_) {
-        average += (double)query.rtt_.count() / num_received;
-      }
+    printf("Tester %u: %s after %.02f ms of waiting for the last answers\n",
+           tester->thread_id_,
+           tester->finished_early_ ? "finished early" : "timed out",
+           tester->tail_wait_.count() / 1000000.0);
+  }
+  /* Time of setting up the testers before the test */
+  std::chrono::nanoseconds setup_max{0}, setup_total{0};
+  for (const auto &tester : dns_testers_) {
+    setup_max = std::max(setup_max, tester->setup_time_);
+    setup_total += tester->setup_time_;
+  }
+  printf("Tester setup time: max %.02f ms, average %.02f ms\n",
+         setup_max.count() / 1000000.0,
+         setup_total.count() / 1000000.0 / dns_testers_.size());
+  /* Retransmission statistics */
+  if (dns_testers_[0]->retries_ > 0) {
+    uint64_t num_retransmissions = totals.retransmissions_;
+    uint64_t num_retransmitted = totals.retransmitted_;
+    uint64_t num_first_try = totals.first_try_;
+    uint64_t num_duplicate = 0;
+    for (const auto &tester : dns_testers_) {
+      num_duplicate += tester->num_duplicate_;
     }
+    printf("Retransmissions: %lu (%.02f%% of the queries retransmitted, "
+           "%.02f packets per query)\n",
+           num_retransmissions, ((double)num_retransmitted / num_total) * 100,
+           (double)(num_total + num_retransmissions) / num_total);
+    printf("Valid answers at first try: %lu (%.02f%%)\n", num_first_try,
+           ((double)num_first_try / num_total) * 100);
+    printf("Valid answers after retransmission: %lu (%.02f%%)\n",
+           num_answered - num_first_try,
+           ((double)(num_answered - num_first_try) / num_total) * 100);
+    printf("Duplicate answers: %lu\n", num_duplicate);
   }
-  /* Standard deviation */
-  standard_deviation = 0;
+  /* Connection statistics */
+  TransportStats transport_stats;
   for (const auto &tester : dns_testers_) {
-    for (auto &query : tester->tests_) {
-      if (query.received_) {
-        standard_deviation += pow(query.rtt_.count() - average, 2.0);
+    transport_stats += tester->transport_stats_;
+  }
+  if (transport_stats.truncated_ > 0) {
+    printf("Truncated UDP answers: %lu (%.02f%%)\n", transport_stats.truncated_,
+           ((double)transport_stats.truncated_ / num_total) * 100);
+  }
+  if (transport_stats.send_errors_ > 0) {
+    printf("Queries that could not be sent: %lu (%.02f%%)\n",
+           transport_stats.send_errors_,
+           ((double)transport_stats.send_errors_ / num_total) * 100);
+  }
+  if (transport_stats.txtime_drops_ > 0) {
+    printf("Queries dropped for missing their launch time: %lu (%.02f%%)\n",
+           transport_stats.txtime_drops_,
+           ((double)transport_stats.txtime_drops_ / num_total) * 100);
+  }
+  uint64_t num_handshakes =
+      transport_stats.handshakes_ + transport_stats.resumed_handshakes_;
+  if (num_handshakes > 0) {
+    /* The rate of the testers handshaking in parallel, over the wall-clock
+     * time from the first handshake to the last one */
+    printf("TLS handshakes: %lu in %.02f ms (%.02f handshakes/s by %zu "
+           "testers in parallel)\n",
+           num_handshakes,
+           std::chrono::duration<double, std::milli>(
+               transport_stats.last_handshake_ -
+               transport_stats.first_handshake_)
+               .count(),
+           num_handshakes /
+               std::chrono::duration<double>(transport_stats.last_handshake_ -
+                                             transport_stats.first_handshake_)
+                   .count(),
+           dns_testers_.size());
+  }
+  if (transport_stats.handshakes_ > 0) {
+    printf("Full TLS handshakes: %lu (%.02f ms each)\n",
+           transport_stats.handshakes_,
+           transport_stats.handshake_time_.count() / 1000000.0 /
+               transport_stats.handshakes_);
+  }
+  if (transport_stats.resumed_handshakes_ > 0) {
+    printf("Resumed TLS handshakes: %lu (%.02f ms each)\n",
+           transport_stats.resumed_handshakes_,
+           transport_stats.resumed_handshake_time_.count() / 1000000.0 /
+               transport_stats.resumed_handshakes_);
+  }
+  if (transport_stats.disconnects_ > 0) {
+    printf("Connections lost during the test: %lu\n",
+           transport_stats.disconnects_);
+  }
+  if (transport_stats.stream_waits_ > 0) {
+    printf("Queries delayed by the stream limit: %lu, waiting %.02f ms in "
+           "total (%.02f ms each)\n",
+           transport_stats.stream_waits_,
+           transport_stats.stream_wait_time_.count() / 1000000.0,
+           transport_stats.stream_wait_time_.count() / 1000000.0 /
+               transport_stats.stream_waits_);
+  }
+  if (transport_stats.stream_errors_ > 0) {
+    printf("Failed HTTP/2 streams: %lu\n", transport_stats.stream_errors_);
+  }
+  if (transport_stats.stream_timeouts_ > 0) {
+    printf("HTTP/2 streams cancelled at the timeout: %lu\n",
+           transport_stats.stream_timeouts_);
+  }
+  if (transport_stats.tcp_connections_ > 0) {
+    printf("TCP connections: %lu (%.02f connections/s)\n",
+           transport_stats.tcp_connections_,
+           transport_stats.tcp_connections_ /
+               std::chrono::duration<double>(transport_stats.last_connect_ -
+                                             transport_stats.first_connect_)
+                   .count());
+    print_distribution("TCP connection setup time",
+                       transport_stats.connect_time_);
+    print_distribution("Time from connection setup to answer",
+                       transport_stats.response_time_);
+    print_distribution("TCP round-trip time including setup",
+                       transport_stats.exchange_time_);
+  }
+  if (transport_stats.fastopen_connections_ > 0) {
+    printf("TCP Fast Open connections: %lu (%.02f%%)\n",
+           transport_stats.fastopen_connections_,
+           ((double)transport_stats.fastopen_connections_ /
+            transport_stats.tcp_connections_) *
+               100);
+  }
+  if (transport_stats.tcp_failures_ > 0) {
+    printf("Failed TCP connections: %lu\n", transport_stats.tcp_failures_);
+  }
+  if (transport_stats.tcp_timeouts_ > 0) {
+    printf("TCP connections closed at the timeout: %lu\n",
+           transport_stats.tcp_timeouts_);
+  }
+  for (size_t i = 0; i < transport_stats.connections_.size(); i++) {
+    const Histogram &latency = transport_stats.connections_[i];
+    printf("Connection %zu: %lu streams, round-trip time min/p50/p90/p99/max: "
+           "%.02f/%.02f/%.02f/%.02f/%.02f ms\n",
+           i, latency.count(), latency.min() / 1000000.0,
+           latency.percentile(50) / 1000000.0,
+           latency.percentile(90) / 1000000.0,
+           latency.percentile(99) / 1000000.0, latency.max() / 1000000.0);
+  }
+  /* Events of the threads, per query sent or answer received */
+  if (dns_testers_[0]->perf_counters_) {
+    printf("Performance counters of the threads:\n");
+    printf("%6s %-8s %12s %12s %6s %12s %12s %12s\n", "Tester", "Thread",
+           "rate/s", "cycles/query", "IPC", "misses/query", "switches",
+           "page faults");
+    for (size_t i = 0; i < dns_testers_.size(); i++) {
+      const DnsTester &tester = *dns_testers_[i];
+      const Summary &summary = summaries[i];
+      if (tester.concurrency_ == 0) {
+        print_counts(tester.thread_id_, "sender", summary.all_sent_,
+                     summary.all_sending_, tester.sender_counts_);
       }
+      print_counts(tester.thread_id_, "receiver", summary.all_received_,
+                   summary.all_receiving_, tester.receiver_counts_);
     }
   }
-  standard_deviation = sqrt(standard_deviation / num_received);
-  /* Print results */
-  printf("Sent queries: %u\n", num_total);
-  printf("Received answers: %u (%.02f%%)\n", num_received,
-         ((double)num_received / num_total) * 100);
-  printf("Valid answers: %u (%.02f%%)\n", num_answered,
-         ((double)num_answered / num_total) * 100);
-  printf("Average round-trip time: %.02f ms\n", average / 1000000.0);
-  printf("Standard deviation of the round-trip time: %.02f ms\n",
-         standard_deviation / 1000000.0);
 }
 
 void DnsTesterAggregator::write(const char *filename) {
@@ -347,27 +1207,32 @@ void DnsTesterAggregator::write(const char *filename) {
   fprintf(fp, "%s\n", "dns64perf++ test parameters");
   fprintf(fp, "server: %s\n", server);
   fprintf(fp, "port: %hu\n", ntohs(first_tester->server_.sin_port));
-  fprintf(fp, "number of requests: %u\n",
-          first_tester->num_req_ * first_tester->num_thread_);
+  uint64_t num_total = 0, num_warmup = 0;
+  for (const auto &tester : dns_testers_) {
+    num_total += tester->measured().size();
+    num_warmup += tester->tests_.size() - tester->measured().size();
+  }
+  fprintf(fp, "number of requests: %lu\n", num_total);
+  if (num_warmup > 0) {
+    fprintf(fp, "warm-up queries (not listed): %lu\n", num_warmup);
+  }
   fprintf(fp, "burst size: %u\n", first_tester->num_burst_);
   fprintf(fp, "number of threads: %u\n", first_tester->num_thread_);
-  fprintf(fp, "delay between bursts: %lu ns\n\n",
+  fprintf(fp, "delay between bursts: %lu ns\n",
           first_tester->burst_delay_.count());
+  if (first_tester->duration_.count() > 0) {
+    fprintf(fp, "duration: %lu ns\n", first_tester->duration_.count());
+  }
+  fprintf(fp, "\n");
   fprintf(
       fp,
       "query;thread id;tsent [ns];treceived [ns];received;answered;rtt [ns]\n");
   /* Write queries */
-  char addr[64];
   char query_addr[512];
-  uint32_t ip;
   for (const auto &tester : dns_testers_) {
-    int n = 0;
-    for (const auto &query : tester->tests_) {
-      ip = tester->ip_ | (tester->num_offset_ + n++);
-      snprintf(addr, sizeof(addr), dns64_addr_format_string, (ip >> 24) & 0xff,
-               (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
-      snprintf(query_addr, sizeof(query_addr), "%s.%s.", addr,
-               dns64_addr_domain);
+    uint64_t n = tester->tests_.size() - tester->measured().size();
+    for (const auto &query : tester->measured()) {
+      tester->name(n++, query_addr, sizeof(query_addr));
       fprintf(fp, "%s;%u;%lu;%lu;%d;%d;%ld\n", query_addr, tester->thread_id_,
               std::chrono::duration_cast<std::chrono::nanoseconds>(
                   query.time_sent_.time_since_epoch())
@@ -26,9 +26,15 @@
 #ifndef DNS_TESTER_H_INCLUDED_
 #define DNS_TESTER_H_INCLUDED_
 
+#include "chunked_store.hpp"
 #include "dns.h"
+#include "histogram.h"
+#include "perf_counters.h"
 #include "raii_socket.h"
 #include "timer.h"
+#include "timer_wheel.h"
+#include "transport.h"
+#include <atomic>
 #include <chrono>
 #include <exception>
 #include <memory>
@@ -39,7 +45,10 @@
 #include <vector>
 
 static const size_t UDP_MAX_LEN = 512;
+static const size_t DNS_MAX_LEN = 65535;
+static const std::chrono::milliseconds TIMER_TICK{1};
 static const char *dns64_addr_format_string = "%03hhu-%03hhu-%03hhu-%03hhu";
+static const char dns64_epoch_format_string[] = "%016lx";
 static const char *dns64_addr_domain = "dns64perf.test";
 
 /**
@@ -73,10 +82,75 @@ struct DnsQuery {
   bool received_;     /**< Flag to mark whether an answer has been received */
   bool answered_;     /**< Flag to mark whether the answer was valid */
   std::chrono::nanoseconds rtt_; /**< Round-trip time of the query */
+  uint8_t retries_; /**< Number of retransmissions of the query */
+  bool timed_out_;  /**< Flag to mark whether the timeout has expired */
 
   DnsQuery();
 };
 
+/**
+ * Class to store the optional parameters of a test
+ */
+struct TesterOptions {
+  TransportType transport_; /**< Transport used to carry the queries */
+  uint32_t tls_sessions_;   /**< Number of TLS sessions per tester */
+  bool tls_resumption_;     /**< Flag to enable TLS session resumption */
+  uint32_t h2_streams_;     /**< Concurrent HTTP/2 streams per connection */
+  std::string doh_path_;    /**< Path of the DoH endpoint */
+  bool tcp_fastopen_;       /**< Flag to enable TCP Fast Open */
+  bool tc_retry_;           /**< Flag to retry truncated answers over TCP */
+  uint32_t retries_;        /**< Maximum number of retransmissions */
+  std::chrono::nanoseconds
+      retry_interval_;   /**< Time before the first retransmission */
+  double retry_backoff_; /**< Multiplier of the time between retransmissions */
+  bool epoch_label_;     /**< Flag to add an epoch label to the names */
+  uint64_t first_epoch_; /**< Epoch of the first pass over the subnet */
+  std::chrono::nanoseconds
+      duration_; /**< Duration of the test, or 0 to send a fixed count */
+  uint64_t warmup_queries_; /**< Number of queries of the warm-up */
+  std::chrono::nanoseconds
+      warmup_duration_; /**< Duration of the warm-up, or 0 to count queries */
+  uint32_t concurrency_; /**< Outstanding queries per tester in the closed-loop
+                            mode, or 0 to send bursts on a timer */
+  std::chrono::nanoseconds slo_latency_; /**< 99th percentile of the
+                                            round-trip time targeted by the
+                                            rate controller, or 0 */
+  double slo_loss_; /**< Ratio of timed out queries allowed by the rate
+                       controller */
+  bool pace_; /**< Flag to spread the queries of a burst over its interval */
+  int32_t txtime_clock_; /**< Clock of the launch times handed to the kernel
+                            with the queries, or -1 to send them at once */
+  bool perf_counters_; /**< Flag to count the events of the threads */
+
+  TesterOptions();
+};
+
+/**
+ * Class to iterate over the queries of a tester from a given one
+ */
+class QueryRange {
+private:
+  const ChunkedStore<DnsQuery> &store_; /**< Queries of the tester */
+  uint64_t first_;                      /**< Index of the first query */
+
+public:
+  /**
+   * Constructor.
+   * @param store the queries
+   * @param first index of the first query, at most the size of the store
+   */
+  QueryRange(const ChunkedStore<DnsQuery> &store, uint64_t first);
+
+  ChunkedStore<DnsQuery>::const_iterator begin() const;
+  ChunkedStore<DnsQuery>::const_iterator end() const;
+
+  /**
+   * Getter for the number of queries.
+   * @return the number of queries
+   */
+  uint64_t size() const;
+};
+
 /**
  * Class to represent a test
  */
@@ -85,32 +159,146 @@ private:
   struct sockaddr_in server_; /**< Address of the server */
   uint32_t ip_;                /**< IP part of the subnet */
   uint8_t netmask_;            /**< Netmask part of the subnet */
-  uint32_t num_req_;           /**< Number of requests */
+  uint64_t num_req_;           /**< Number of requests, or the upper limit */
   uint32_t num_burst_;         /**< Burst size */
   uint32_t num_thread_;        /**< Number of threads */
   uint32_t thread_id_;         /**< Thread id of this tester */
   std::chrono::time_point<std::chrono::high_resolution_clock>
       test_start_time_; /**< Time to start the test */
-  uint32_t num_offset_; /**< IP offset of this tester */
+  uint64_t num_offset_; /**< Query offset of this tester */
+  uint64_t stride_;     /**< Distance of the queries of this tester */
+  bool epoch_label_;    /**< Flag to add an epoch label to the names */
+  uint64_t first_epoch_; /**< Epoch of the first pass over the subnet */
   std::chrono::nanoseconds
       burst_delay_; /**< Time between bursts in nanoseconds */
+  std::chrono::nanoseconds
+      duration_; /**< Duration of the test, or 0 to send a fixed count */
+  std::chrono::time_point<std::chrono::high_resolution_clock>
+      test_end_time_; /**< Time to stop sending in a duration-based test */
   struct timeval timeout_;
-  Socket sock_; /**< Socket for sending and receiving queries */
+  std::unique_ptr<Transport>
+      transport_; /**< Transport for sending and receiving queries */
+  bool reused_; /**< Flag to mark a transport taken over from the tester of
+                   the previous phase, which may still receive its answers */
   uint8_t query_data_[UDP_MAX_LEN]; /**< Array to store the packet */
   std::unique_ptr<DNSPacket>
       query_; /**< The DNSPacket representation of the query */
-  std::vector<DnsQuery> tests_;  /**< Test queries */
-  uint32_t num_sent_;            /**< Number of sent queries so far */
+  ChunkedStore<DnsQuery> tests_; /**< Test queries */
+  uint64_t num_sent_;            /**< Number of sent queries so far */
+  bool sending_done_;            /**< Flag to mark the end of sending */
+  size_t num_bursts_;            /**< Number of timer ticks */
+  size_t num_ticks_;             /**< Number of timer ticks so far */
   std::mutex m_;                 /**< Mutex for accessing queries */
   std::unique_ptr<Timer> timer_; /**< Timer for scheduling queries */
+  uint32_t retries_; /**< Maximum number of retransmissions of a query */
+  std::chrono::nanoseconds
+      retry_interval_;   /**< Time before the first retransmission */
+  double retry_backoff_; /**< Multiplier of the time between retransmissions */
+  uint8_t retry_data_[UDP_MAX_LEN]; /**< Array to store the retransmission */
+  std::unique_ptr<DNSPacket>
+      retry_; /**< The DNSPacket representation of the retransmission */
+  std::unique_ptr<TimerWheel>
+      wheel_; /**< Timer wheel of the retransmissions and timeouts */
+  uint64_t num_scheduled_; /**< Number of sent queries put on the wheel */
+  std::atomic<uint64_t>
+      num_resolved_;       /**< Number of queries answered or timed out */
+  uint64_t num_duplicate_; /**< Number of answers to answered queries */
+  uint64_t num_late_;      /**< Number of answers after the timeout */
+  bool finished_early_; /**< Flag to mark that no query has timed out */
+  std::chrono::nanoseconds
+      tail_wait_; /**< Time spent receiving after the last query was sent */
+  TransportStats
+      transport_stats_; /**< Connection statistics at the end of the test */
+  std::chrono::nanoseconds
+      setup_time_; /**< Time spent in the constructor before the test */
+  uint64_t num_warmup_; /**< Number of the first queries excluded from the
+                           results */
+  std::chrono::nanoseconds
+      warmup_time_; /**< Time of sending the warm-up before the test */
+  uint32_t concurrency_; /**< Outstanding queries in the closed-loop mode, or
+                            0 */
+  bool rate_control_; /**< Flag to collect the window of the rate controller */
+  std::atomic<int64_t>
+      next_delay_; /**< Time between bursts set by the rate controller, or 0 */
+  std::mutex window_m_; /**< Mutex for accessing the window */
+  Histogram window_rtt_; /**< Round-trip times of the current window */
+  uint64_t window_lost_; /**< Timed out queries of the current window */
+  std::chrono::nanoseconds
+      pace_gap_; /**< Time between the queries of a burst, or 0 */
+  bool txtime_; /**< Flag to hand the queries to the kernel TXTIME_LEAD ahead
+                   of their launch time */
+  std::chrono::high_resolution_clock::time_point
+      next_launch_; /**< Launch time of the next burst */
+  std::chrono::nanoseconds
+      launch_delay_; /**< Time between the launch times of bursts */
+  bool perf_counters_; /**< Flag to count the events of the threads */
+  std::unique_ptr<PerfCounters>
+      sender_counters_;        /**< Counters of the sender thread, or empty */
+  PerfCounts sender_counts_;   /**< Events of the sender thread */
+  PerfCounts receiver_counts_; /**< Events of the receiver thread */
+  Histogram slip_; /**< Lateness of the ticks of the sender in nanoseconds */
 
   friend class DnsTesterAggregator;
+  friend class ControlMessage;
+
+  /**
+   * Constructor of a finished tester received from an agent.
+   */
+  DnsTester();
+
+  /**
+   * Getter for the queries of the results, without the warm-up
+   * @return the queries
+   */
+  QueryRange measured() const;
+
+  /**
+   * Sets the label and the transaction ID of a query
+   * @param packet the query
+   * @param n index of the query
+   */
+  void prepare(DNSPacket &packet, uint64_t n);
+
+  /**
+   * Writes the domain name of a query
+   * @param n index of the query
+   * @param buffer the buffer to write into
+   * @param len the length of the buffer
+   */
+  void name(uint64_t n, char *buffer, size_t len) const;
+
+  /**
+   * Converts a time to a tick of the timer wheel
+   * @param time the time
+   * @return the tick
+   */
+  uint64_t tick(std::chrono::high_resolution_clock::time_point time) const;
+
+  /**
+   * Sends the next query
+   * @param launch launch time of the query with txtime, or the epoch of the
+   * clock to send it at once
+   */
+  void send(std::chrono::high_resolution_clock::time_point launch =
+                std::chrono::high_resolution_clock::time_point{});
 
   /**
    * Sends a burst
    */
   void test();
 
+  /**
+   * Sends queries until concurrency_ of them are outstanding, called by the
+   * receiver in the closed-loop mode
+   */
+  void refill();
+
+  /**
+   * Advances the timers of the outstanding queries, retransmitting them and
+   * timing them out, called by the receiver
+   */
+  void track();
+
 public:
   /**
    * Constructor.
@@ -120,31 +308,124 @@ public:
    * @param num_req number of requests
    * @param num_burst size of burst
    * @param burst_delay delay between bursts in nanoseconds
+   * @param options optional parameters of the test
+   * @param transport the transport of the tester of the previous phase to
+   * take over, or empty to create a new one
    */
   DnsTester(struct in_addr server_addr, uint16_t port, uint32_t ip,
-            uint8_t netmask, uint32_t num_req, uint32_t num_burst,
+            uint8_t netmask, uint64_t num_req, uint32_t num_burst,
             uint32_t thread_num, uint32_t thread_id,
-            const std::chrono::time_point<std::chrono::high_resolution_clock>
-                &test_start_time,
-            std::chrono::nanoseconds burst_delay, struct timeval timeout);
+            std::chrono::nanoseconds burst_delay, struct timeval timeout,
+            const TesterOptions &options,
+            std::unique_ptr<Transport> transport = std::unique_ptr<Transport>{});
 
   /**
    * Starts the test
+   * @param test_start_time time to send the first burst
+   * @param sender_cpu the CPU to pin the sender to, or -1
    */
-  void start();
+  void start(const std::chrono::time_point<std::chrono::high_resolution_clock>
+                 &test_start_time,
+             int sender_cpu = -1);
+
+  /**
+   * Takes the transport of a finished tester, to hand it over to the tester
+   * of the next phase.
+   * @return the transport
+   */
+  std::unique_ptr<Transport> release_transport();
+
+  /**
+   * Getter for the number of queries sent and neither answered nor timed
+   * out yet, can be called while the test is running
+   * @return the number of outstanding queries
+   */
+  uint64_t outstanding();
+
+  /**
+   * Getter for the end of sending, can be called while the test is running
+   * @return true if every query has been sent
+   */
+  bool sending_done();
+
+  /**
+   * Changes the time between bursts from the next burst, can be called while
+   * the test is running
+   * @param burst_delay the new time between bursts
+   */
+  void reschedule(std::chrono::nanoseconds burst_delay);
+
+  /**
+   * Takes the results of the measured queries resolved since the last call,
+   * can be called while the test is running with a rate controller
+   * @param rtt the histogram to add the round-trip times of the answers to
+   * @return the number of queries timed out
+   */
+  uint64_t window(Histogram &rtt);
 };
 
 class DnsTesterAggregator {
 private:
+  /**
+   * Class to store the results of the queries of a tester, or of several
+   * testers merged
+   */
+  struct Summary {
+    uint64_t total_;     /**< Number of queries, without the warm-up */
+    uint64_t received_;  /**< Number of received answers */
+    uint64_t answered_;  /**< Number of valid answers */
+    uint64_t timed_out_; /**< Number of timed out queries */
+    uint64_t early_; /**< Number of answers before the launch time of their
+                        query */
+    uint64_t retransmissions_; /**< Number of retransmissions */
+    uint64_t retransmitted_;   /**< Number of queries retransmitted */
+    uint64_t first_try_; /**< Number of valid answers at the first try */
+    double mean_;        /**< Average round-trip time in nanoseconds */
+    double m2_; /**< Sum of the squared differences from the average */
+    Histogram rtt_;  /**< Round-trip times in nanoseconds */
+    Histogram gaps_; /**< Times between consecutive queries in nanoseconds */
+    std::chrono::high_resolution_clock::time_point
+        first_sent_; /**< Time of sending the first query */
+    std::chrono::high_resolution_clock::time_point
+        last_sent_; /**< Time of sending the last query */
+    std::chrono::high_resolution_clock::time_point
+        last_received_; /**< Time of receiving the last answer */
+    uint64_t all_sent_; /**< Number of queries with the warm-up */
+    uint64_t all_received_; /**< Number of answers with the warm-up */
+    std::chrono::nanoseconds
+        all_sending_; /**< Time of sending with the warm-up */
+    std::chrono::nanoseconds
+        all_receiving_; /**< Time of receiving with the warm-up */
+
+    Summary();
+
+    /**
+     * Merges the results of other testers into these ones.
+     * @param rhs the results to merge
+     * @return reference to this
+     */
+    Summary &operator+=(const Summary &rhs);
+  };
+
   const std::vector<std::unique_ptr<DnsTester>> &dns_testers_;
+  bool per_tester_; /**< Flag to print the results of every tester */
+
+  /**
+   * Collects the results of a tester in a single pass over its queries.
+   * @param tester the tester
+   * @return the results
+   */
+  static Summary summarize(const DnsTester &tester);
 
 public:
   /**
    * Constructor.
    * @param dns_testers DnsTesters to aggregate from
+   * @param per_tester whether to print the results of every tester too
    */
   DnsTesterAggregator(
-      const std::vector<std::unique_ptr<DnsTester>> &dns_testers);
+      const std::vector<std::unique_ptr<DnsTester>> &dns_testers,
+      bool per_tester = false);
 
   /**
    * Displays the aggregated test results
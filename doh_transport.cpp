@@ -0,0 +1,616 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "doh_transport.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <openssl/err.h>
+#include <sstream>
+#include <sys/epoll.h>
+#include <thread>
+
+static const size_t DOH_MAX_EVENTS = 64;
+static const size_t DOH_MAX_PENDING_WRITE = 1 << 20;
+static const char H2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const unsigned char H2_ALPN[] = {2, 'h', '2'};
+static const uint32_t H2_MAX_WINDOW = 0x7fffffff;
+static const uint32_t H2_DEFAULT_WINDOW = 65535;
+static const uint32_t H2_MAX_STREAM_ID = 0x7fffffff;
+static const uint32_t H2_CANCEL = 0x8;
+
+/**
+ * Enum for the HTTP/2 frame types.
+ */
+enum H2FrameType {
+  DATA = 0,
+  HEADERS = 1,
+  PRIORITY = 2,
+  RST_STREAM = 3,
+  SETTINGS = 4,
+  PUSH_PROMISE = 5,
+  PING = 6,
+  GOAWAY = 7,
+  WINDOW_UPDATE = 8,
+  CONTINUATION = 9
+};
+
+/**
+ * Enum for the HTTP/2 frame flags.
+ */
+enum H2Flag {
+  END_STREAM = 0x1,
+  ACK = 0x1,
+  END_HEADERS = 0x4,
+  PADDED = 0x8,
+  PRIORITY_INFO = 0x20
+};
+
+/**
+ * Enum for the HTTP/2 settings.
+ */
+enum H2Setting {
+  ENABLE_PUSH = 0x2,
+  MAX_CONCURRENT_STREAMS = 0x3,
+  INITIAL_WINDOW_SIZE = 0x4
+};
+
+/**
+ * Appends an HPACK integer with the given prefix.
+ */
+static void hpack_int(std::vector<uint8_t> &out, uint8_t first,
+                      unsigned prefix_bits, uint64_t value) {
+  uint64_t max = (1 << prefix_bits) - 1;
+  if (value < max) {
+    out.push_back(first | value);
+    return;
+  }
+  out.push_back(first | max);
+  value -= max;
+  while (value >= 0x80) {
+    out.push_back((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(value);
+}
+
+/**
+ * Appends an HPACK literal header field without indexing, with the name
+ * taken from the static table.
+ */
+static void hpack_literal(std::vector<uint8_t> &out, unsigned name_index,
+                          const std::string &value) {
+  hpack_int(out, 0x00, 4, name_index);
+  hpack_int(out, 0x00, 7, value.size());
+  out.insert(out.end(), value.begin(), value.end());
+}
+
+/**
+ * Appends a 32 bit big endian value.
+ */
+static void put32(std::vector<uint8_t> &out, uint32_t value) {
+  out.push_back((value >> 24) & 0xff);
+  out.push_back((value >> 16) & 0xff);
+  out.push_back((value >> 8) & 0xff);
+  out.push_back(value & 0xff);
+}
+
+/**
+ * Reads a 32 bit big endian value.
+ */
+static uint32_t get32(const uint8_t *p) {
+  return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/**
+ * Decodes a Huffman coded string of three digits.
+ * @return the number, or 0 if it is not three digits
+ */
+static int huffman_digits(const uint8_t *data, size_t len) {
+  uint32_t bits = 0;
+  for (size_t i = 0; i < len && i < 4; i++) {
+    bits |= data[i] << (24 - 8 * i);
+  }
+  int value = 0;
+  unsigned used = 0;
+  for (int i = 0; i < 3; i++) {
+    uint32_t code = (bits << used) >> 27;
+    /* '0'-'2' are 5 bit codes, '3'-'9' are 6 bit codes from 011001 */
+    if (code < 3) {
+      used += 5;
+    } else {
+      code = (bits << used) >> 26;
+      if (code < 25 || code > 31) {
+        return 0;
+      }
+      code -= 22;
+      used += 6;
+    }
+    value = value * 10 + code;
+  }
+  return used <= len * 8 ? value : 0;
+}
+
+/**
+ * Finds the response status in an HPACK header block, which is always the
+ * first field of a response.
+ * @return the status, or 0 if it is encoded in a way that needs the dynamic
+ * table to decode
+ */
+static int response_status(const uint8_t *block, size_t len) {
+  static const int static_status[] = {200, 204, 206, 304, 400, 404, 500};
+  size_t pos = 0;
+  /* Skip dynamic table size updates */
+  while (pos < len && (block[pos] & 0xe0) == 0x20) {
+    if ((block[pos++] & 0x1f) == 0x1f) {
+      while (pos < len && (block[pos] & 0x80)) {
+        pos++;
+      }
+      pos++;
+    }
+  }
+  if (pos >= len) {
+    return 0;
+  }
+  /* Indexed field from the static table */
+  if (block[pos] >= 0x88 && block[pos] <= 0x8e) {
+    return static_status[block[pos] - 0x88];
+  }
+  /* Literal field with the :status name from the static table */
+  uint8_t first = block[pos];
+  unsigned name_index = (first & 0xc0) == 0x40   ? first & 0x3f
+                        : (first & 0xe0) == 0x00 ? first & 0x0f
+                                                 : 0;
+  if (name_index >= 8 && name_index <= 14) {
+    pos++;
+    if (pos >= len) {
+      return 0;
+    }
+    size_t vlen = block[pos] & 0x7f;
+    bool huffman = block[pos] & 0x80;
+    pos++;
+    if (pos + vlen > len) {
+      return 0;
+    }
+    if (huffman) {
+      return huffman_digits(block + pos, vlen);
+    } else if (vlen == 3) {
+      int status = 0;
+      for (size_t i = 0; i < 3; i++) {
+        status = status * 10 + (block[pos + i] - '0');
+      }
+      return status;
+    }
+  }
+  return 0;
+}
+
+DohTransport::Connection::Connection()
+    : ssl_{nullptr}, id_{0}, alive_{false}, next_stream_id_{1},
+      max_streams_{0}, send_window_{H2_DEFAULT_WINDOW}, consumed_{0},
+      rbuf_(65536), rpos_{0}, rlen_{0}, want_write_{false} {}
+
+DohTransport::Connection::~Connection() {
+  if (ssl_ != nullptr) {
+    SSL_free(ssl_);
+  }
+}
+
+DohTransport::DohTransport(const struct sockaddr_in &server,
+                           struct timeval timeout, uint32_t num_connections,
+                           uint32_t max_streams, const std::string &path,
+                           bool resumption,
+                           std::chrono::nanoseconds query_timeout)
+    : TlsTransport{server, timeout, resumption, H2_ALPN, sizeof(H2_ALPN)},
+      max_streams_{max_streams}, query_timeout_{query_timeout}, next_{0} {
+  if (num_connections == 0 || max_streams == 0) {
+    throw TransportException{
+        "At least one connection and one stream per connection is needed."};
+  }
+  /* The constant part of the request headers */
+  char server_text[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, reinterpret_cast<const void *>(&server_.sin_addr),
+            server_text, sizeof(server_text));
+  headers_.push_back(0x83); /* :method: POST */
+  headers_.push_back(0x87); /* :scheme: https */
+  hpack_literal(headers_, 4, path);
+  hpack_literal(headers_, 1,
+                std::string{server_text} + ":" +
+                    std::to_string(ntohs(server_.sin_port)));
+  hpack_literal(headers_, 31, "application/dns-message");
+  hpack_literal(headers_, 19, "application/dns-message");
+  /* Establish the connections */
+  for (uint32_t i = 0; i < num_connections; i++) {
+    connections_.emplace_back(new Connection{});
+    Connection &connection = *connections_.back();
+    connection.id_ = i;
+    connection.ssl_ = connect(connection.sock_);
+    const unsigned char *alpn;
+    unsigned int alpn_len;
+    SSL_get0_alpn_selected(connection.ssl_, &alpn, &alpn_len);
+    if (alpn_len != 2 || memcmp(alpn, "h2", 2) != 0) {
+      throw TransportException{"The DUT does not support HTTP/2."};
+    }
+    connection.alive_ = true;
+    connection.max_streams_ = max_streams_;
+    if (resumption_ && i + 1 < num_connections) {
+      connection.rlen_ =
+          await_ticket(connection.sock_, connection.ssl_,
+                       connection.rbuf_.data(), connection.rbuf_.size());
+    }
+    stats_.connections_.emplace_back();
+    watch(connection.sock_, i);
+    /* Connection preface, settings and a large receive window */
+    std::lock_guard<std::mutex> lock{connection.m_};
+    connection.wbuf_.insert(connection.wbuf_.end(), H2_PREFACE,
+                            H2_PREFACE + sizeof(H2_PREFACE) - 1);
+    frame(connection, 12, SETTINGS, 0, 0);
+    connection.wbuf_.push_back(0);
+    connection.wbuf_.push_back(ENABLE_PUSH);
+    put32(connection.wbuf_, 0);
+    connection.wbuf_.push_back(0);
+    connection.wbuf_.push_back(INITIAL_WINDOW_SIZE);
+    put32(connection.wbuf_, H2_MAX_WINDOW);
+    frame(connection, 4, WINDOW_UPDATE, 0, 0);
+    put32(connection.wbuf_, H2_MAX_WINDOW - H2_DEFAULT_WINDOW);
+    process_frames(connection);
+    flush(connection);
+  }
+}
+
+void DohTransport::frame(Connection &connection, uint32_t len, uint8_t type,
+                         uint8_t flags, uint32_t stream_id) {
+  connection.wbuf_.push_back((len >> 16) & 0xff);
+  connection.wbuf_.push_back((len >> 8) & 0xff);
+  connection.wbuf_.push_back(len & 0xff);
+  connection.wbuf_.push_back(type);
+  connection.wbuf_.push_back(flags);
+  put32(connection.wbuf_, stream_id);
+}
+
+void DohTransport::flush(Connection &connection) {
+  while (!connection.wbuf_.empty()) {
+    int ret = SSL_write(connection.ssl_, connection.wbuf_.data(),
+                        (int)connection.wbuf_.size());
+    if (ret > 0) {
+      connection.wbuf_.erase(connection.wbuf_.begin(),
+                             connection.wbuf_.begin() + ret);
+      continue;
+    }
+    int err = SSL_get_error(connection.ssl_, ret);
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+      break;
+    }
+    /* The connection is broken */
+    ERR_clear_error();
+    connection.wbuf_.clear();
+    if (connection.alive_) {
+      connection.alive_ = false;
+      disconnects_++;
+    }
+  }
+  /* Let the receiver finish the writing when the socket becomes writable */
+  bool want_write = !connection.wbuf_.empty();
+  if (want_write != connection.want_write_) {
+    struct epoll_event event;
+    memset(&event, 0x00, sizeof(event));
+    event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+    event.data.u64 = connection.id_;
+    ::epoll_ctl(epoll_, EPOLL_CTL_MOD, connection.sock_, &event);
+    connection.want_write_ = want_write;
+  }
+}
+
+void DohTransport::send(const uint8_t *data, size_t len) {
+  bool waited = false;
+  std::chrono::high_resolution_clock::time_point wait_start;
+  for (;;) {
+    bool any_alive = false;
+    for (size_t tries = 0; tries < connections_.size(); tries++) {
+      Connection &connection = *connections_[next_++ % connections_.size()];
+      std::lock_guard<std::mutex> lock{connection.m_};
+      if (connection.alive_ && connection.next_stream_id_ > H2_MAX_STREAM_ID) {
+        connection.alive_ = false;
+      }
+      if (!connection.alive_) {
+        continue;
+      }
+      any_alive = true;
+      /* Respect the stream limit and the flow control window */
+      if (connection.streams_.size() >= connection.max_streams_ ||
+          connection.send_window_ < (int64_t)len ||
+          connection.wbuf_.size() > DOH_MAX_PENDING_WRITE) {
+        continue;
+      }
+      uint32_t stream_id = connection.next_stream_id_;
+      connection.next_stream_id_ += 2;
+      Stream &stream = connection.streams_[stream_id];
+      stream.time_sent_ = std::chrono::high_resolution_clock::now();
+      stream.ok_ = true;
+      connection.sent_.emplace_back(stream_id, stream.time_sent_);
+      if (waited) {
+        stats_.stream_wait_time_ += stream.time_sent_ - wait_start;
+      }
+      /* HEADERS frame */
+      size_t begin = connection.wbuf_.size();
+      frame(connection, 0, HEADERS, END_HEADERS, stream_id);
+      connection.wbuf_.insert(connection.wbuf_.end(), headers_.begin(),
+                              headers_.end());
+      hpack_literal(connection.wbuf_, 28, std::to_string(len));
+      size_t headers_len = connection.wbuf_.size() - begin - 9;
+      connection.wbuf_[begin] = (headers_len >> 16) & 0xff;
+      connection.wbuf_[begin + 1] = (headers_len >> 8) & 0xff;
+      connection.wbuf_[begin + 2] = headers_len & 0xff;
+      /* DATA frame */
+      frame(connection, len, DATA, END_STREAM, stream_id);
+      connection.wbuf_.insert(connection.wbuf_.end(), data, data + len);
+      connection.send_window_ -= len;
+      flush(connection);
+      return;
+    }
+    if (!any_alive) {
+      if (waited) {
+        stats_.stream_wait_time_ +=
+            std::chrono::high_resolution_clock::now() - wait_start;
+      }
+      send_errors_++;
+      std::cerr << "Can't send packet." << std::endl;
+      return;
+    }
+    /* Every connection is at its limit, wait for the receiver to finish or
+     * cancel streams, but not longer than a query may be outstanding */
+    auto now = std::chrono::high_resolution_clock::now();
+    if (!waited) {
+      stats_.stream_waits_++;
+      waited = true;
+      wait_start = now;
+    } else if (now - wait_start >= query_timeout_) {
+      stats_.stream_wait_time_ += now - wait_start;
+      send_errors_++;
+      std::cerr << "Can't send packet, every stream is in use." << std::endl;
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds{10});
+  }
+}
+
+void DohTransport::finish_stream(Connection &connection, uint32_t stream_id) {
+  auto it = connection.streams_.find(stream_id);
+  if (it == connection.streams_.end()) {
+    return;
+  }
+  if (it->second.ok_ && !it->second.data_.empty()) {
+    stats_.connections_[connection.id_].add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - it->second.time_sent_)
+            .count());
+    ready_.push_back(std::move(it->second.data_));
+  } else {
+    stats_.stream_errors_++;
+  }
+  connection.streams_.erase(it);
+}
+
+void DohTransport::expire() {
+  auto deadline = std::chrono::high_resolution_clock::now() - query_timeout_;
+  for (auto &connection_ptr : connections_) {
+    Connection &connection = *connection_ptr;
+    std::lock_guard<std::mutex> lock{connection.m_};
+    bool cancelled = false;
+    while (!connection.sent_.empty() &&
+           connection.sent_.front().second < deadline) {
+      /* The stream may have been finished or reset meanwhile */
+      uint32_t stream_id = connection.sent_.front().first;
+      if (connection.streams_.erase(stream_id) > 0) {
+        stats_.stream_timeouts_++;
+        if (connection.alive_) {
+          frame(connection, 4, RST_STREAM, 0, stream_id);
+          put32(connection.wbuf_, H2_CANCEL);
+          cancelled = true;
+        }
+      }
+      connection.sent_.pop_front();
+    }
+    if (cancelled) {
+      flush(connection);
+    }
+  }
+}
+
+void DohTransport::process_frames(Connection &connection) {
+  while (connection.rlen_ - connection.rpos_ >= 9) {
+    const uint8_t *header = &connection.rbuf_[connection.rpos_];
+    uint32_t len = (header[0] << 16) | (header[1] << 8) | header[2];
+    if (connection.rlen_ - connection.rpos_ < 9 + len) {
+      break;
+    }
+    uint8_t type = header[3];
+    uint8_t flags = header[4];
+    uint32_t stream_id = get32(header + 5) & 0x7fffffff;
+    const uint8_t *payload = header + 9;
+    size_t payload_len = len;
+    connection.rpos_ += 9 + len;
+    /* Strip padding and priority information */
+    if ((type == DATA || type == HEADERS) && (flags & PADDED)) {
+      if (payload_len < 1 || payload[0] >= payload_len) {
+        continue;
+      }
+      payload_len -= payload[0] + 1;
+      payload++;
+    }
+    if (type == HEADERS && (flags & PRIORITY_INFO)) {
+      if (payload_len < 5) {
+        continue;
+      }
+      payload += 5;
+      payload_len -= 5;
+    }
+    switch (type) {
+    case DATA: {
+      connection.consumed_ += len;
+      auto it = connection.streams_.find(stream_id);
+      if (it != connection.streams_.end()) {
+        it->second.data_.insert(it->second.data_.end(), payload,
+                                payload + payload_len);
+        if (flags & END_STREAM) {
+          finish_stream(connection, stream_id);
+        }
+      }
+    } break;
+    case HEADERS: {
+      auto it = connection.streams_.find(stream_id);
+      if (it != connection.streams_.end()) {
+        /* Trailers do not change the status */
+        if (it->second.data_.empty()) {
+          int status = response_status(payload, payload_len);
+          it->second.ok_ = status == 200 || status == 0;
+        }
+        if (flags & END_STREAM) {
+          finish_stream(connection, stream_id);
+        }
+      }
+    } break;
+    case RST_STREAM:
+      if (connection.streams_.erase(stream_id) > 0) {
+        stats_.stream_errors_++;
+      }
+      break;
+    case SETTINGS:
+      if (!(flags & ACK)) {
+        for (size_t i = 0; i + 6 <= payload_len; i += 6) {
+          uint16_t id = (payload[i] << 8) | payload[i + 1];
+          uint32_t value = get32(payload + i + 2);
+          if (id == MAX_CONCURRENT_STREAMS) {
+            connection.max_streams_ = std::min(max_streams_, value);
+          }
+        }
+        frame(connection, 0, SETTINGS, ACK, 0);
+      }
+      break;
+    case PING:
+      if (!(flags & ACK) && payload_len == 8) {
+        frame(connection, 8, PING, ACK, 0);
+        connection.wbuf_.insert(connection.wbuf_.end(), payload, payload + 8);
+      }
+      break;
+    case GOAWAY:
+      /* No new streams, but the open ones may still be answered */
+      if (connection.alive_) {
+        connection.alive_ = false;
+        disconnects_++;
+      }
+      break;
+    case WINDOW_UPDATE:
+      if (stream_id == 0 && payload_len == 4) {
+        connection.send_window_ += get32(payload) & 0x7fffffff;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  if (connection.rpos_ == connection.rlen_) {
+    connection.rpos_ = connection.rlen_ = 0;
+  }
+  /* Give back the receive window in large chunks */
+  if (connection.consumed_ >= H2_MAX_WINDOW / 2) {
+    frame(connection, 4, WINDOW_UPDATE, 0, 0);
+    put32(connection.wbuf_, connection.consumed_);
+    connection.consumed_ = 0;
+  }
+}
+
+void DohTransport::read_available(Connection &connection) {
+  std::lock_guard<std::mutex> lock{connection.m_};
+  for (;;) {
+    /* Make room in the buffer */
+    if (connection.rbuf_.size() - connection.rlen_ < 16384) {
+      if (connection.rpos_ > 0) {
+        memmove(connection.rbuf_.data(),
+                connection.rbuf_.data() + connection.rpos_,
+                connection.rlen_ - connection.rpos_);
+        connection.rlen_ -= connection.rpos_;
+        connection.rpos_ = 0;
+      }
+      if (connection.rbuf_.size() - connection.rlen_ < 16384) {
+        connection.rbuf_.resize(connection.rbuf_.size() * 2);
+      }
+    }
+    int ret =
+        SSL_read(connection.ssl_, connection.rbuf_.data() + connection.rlen_,
+                 (int)(connection.rbuf_.size() - connection.rlen_));
+    if (ret > 0) {
+      connection.rlen_ += ret;
+      process_frames(connection);
+      continue;
+    }
+    int err = SSL_get_error(connection.ssl_, ret);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+      break;
+    }
+    /* The connection is closed or broken */
+    ERR_clear_error();
+    if (connection.alive_) {
+      connection.alive_ = false;
+      disconnects_++;
+    }
+    connection.wbuf_.clear();
+    ::epoll_ctl(epoll_, EPOLL_CTL_DEL, connection.sock_, nullptr);
+    return;
+  }
+  flush(connection);
+}
+
+ssize_t DohTransport::receive(uint8_t *buffer, size_t maxlen) {
+  struct epoll_event events[DOH_MAX_EVENTS];
+  for (;;) {
+    /* Return the already received messages first */
+    if (!ready_.empty()) {
+      size_t len = std::min(ready_.front().size(), maxlen);
+      memcpy(buffer, ready_.front().data(), len);
+      ready_.pop_front();
+      return len;
+    }
+    expire();
+    int n = ::epoll_wait(epoll_, events, DOH_MAX_EVENTS, timeout_ms());
+    if (n == 0) {
+      errno = EWOULDBLOCK;
+      return -1;
+    } else if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    for (int i = 0; i < n; i++) {
+      Connection &connection = *connections_[events[i].data.u64];
+      if (events[i].events & EPOLLOUT) {
+        std::lock_guard<std::mutex> lock{connection.m_};
+        flush(connection);
+      }
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        read_available(connection);
+      }
+    }
+  }
+}
@@ -0,0 +1,156 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the DNS over HTTPS transport
+ */
+
+#ifndef DOH_TRANSPORT_H_INCLUDED_
+#define DOH_TRANSPORT_H_INCLUDED_
+
+#include "tls_transport.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Class for sending queries over DNS over HTTPS (RFC 8484) on HTTP/2.
+ * Every query is a POST request on its own stream, and the streams are
+ * multiplexed over a small number of TLS connections, each limited to a
+ * number of concurrent streams. Only the part of HTTP/2 needed for this is
+ * implemented: the request headers are encoded with the static HPACK table,
+ * and of the response headers only the status is checked.
+ */
+class DohTransport : public TlsTransport {
+private:
+  /**
+   * Class to represent one request in flight.
+   */
+  struct Stream {
+    std::chrono::high_resolution_clock::time_point
+        time_sent_;             /**< Timestamp of the request */
+    bool ok_;                   /**< Flag to mark a 200 response status */
+    std::vector<uint8_t> data_; /**< Response body */
+  };
+
+  /**
+   * Class to represent one HTTP/2 connection.
+   */
+  struct Connection {
+    Socket sock_;               /**< TCP socket of the connection */
+    SSL *ssl_;                  /**< OpenSSL connection object */
+    std::mutex m_;              /**< Mutex for accessing the connection */
+    size_t id_;                 /**< Index of the connection */
+    bool alive_;                /**< Flag to mark whether it is usable */
+    uint32_t next_stream_id_;   /**< Identifier of the next stream */
+    uint32_t max_streams_;      /**< Limit of concurrent streams */
+    int64_t send_window_;       /**< Connection level flow control window */
+    uint64_t consumed_;         /**< Received data not yet acknowledged */
+    std::vector<uint8_t> rbuf_; /**< Buffer of the received stream */
+    size_t rpos_;               /**< Read position in rbuf_ */
+    size_t rlen_;               /**< Amount of valid data in rbuf_ */
+    std::vector<uint8_t> wbuf_; /**< Frames waiting to be written */
+    bool want_write_;           /**< Flag to mark EPOLLOUT interest */
+    std::unordered_map<uint32_t, Stream> streams_; /**< Open streams */
+    std::deque<
+        std::pair<uint32_t, std::chrono::high_resolution_clock::time_point>>
+        sent_; /**< Identifiers and send times of the streams in the order of
+                  sending, to cancel them at the timeout */
+
+    Connection();
+    ~Connection();
+  };
+
+  std::vector<std::unique_ptr<Connection>> connections_; /**< Connections */
+  uint32_t max_streams_;   /**< Configured limit of concurrent streams */
+  std::chrono::nanoseconds
+      query_timeout_; /**< Time after which a stream is cancelled */
+  std::vector<uint8_t> headers_; /**< Constant part of the header block */
+  std::atomic<size_t> next_;     /**< Next connection to send on */
+  std::deque<std::vector<uint8_t>> ready_; /**< Received DNS messages */
+
+  /**
+   * Appends a frame header to the write buffer of a connection.
+   */
+  static void frame(Connection &connection, uint32_t len, uint8_t type,
+                    uint8_t flags, uint32_t stream_id);
+
+  /**
+   * Writes as much of the write buffer as possible without blocking.
+   * Must be called with the connection locked.
+   * @param connection the connection to flush
+   */
+  void flush(Connection &connection);
+
+  /**
+   * Reads and processes everything available on a connection.
+   * @param connection the connection to read
+   */
+  void read_available(Connection &connection);
+
+  /**
+   * Processes the complete frames in the receive buffer of a connection.
+   * Must be called with the connection locked.
+   * @param connection the connection
+   */
+  void process_frames(Connection &connection);
+
+  /**
+   * Finishes a stream whose response is complete.
+   * Must be called with the connection locked.
+   * @param connection the connection
+   * @param stream_id identifier of the stream
+   */
+  void finish_stream(Connection &connection, uint32_t stream_id);
+
+  /**
+   * Cancels the streams opened longer than the query timeout ago, so that
+   * the unanswered queries do not hold the stream limit forever.
+   */
+  void expire();
+
+public:
+  /**
+   * Constructor.
+   * @param server address of the server
+   * @param timeout receive timeout
+   * @param num_connections number of TLS connections
+   * @param max_streams limit of concurrent streams per connection
+   * @param path the path of the DoH endpoint
+   * @param resumption whether to resume session tickets
+   * @param query_timeout time after which an unanswered stream is cancelled,
+   * and the longest time a query waits for a free stream
+   */
+  DohTransport(const struct sockaddr_in &server, struct timeval timeout,
+               uint32_t num_connections, uint32_t max_streams,
+               const std::string &path, bool resumption,
+               std::chrono::nanoseconds query_timeout);
+
+  void send(const uint8_t *data, size_t len) override;
+
+  ssize_t receive(uint8_t *buffer, size_t maxlen) override;
+};
+
+#endif
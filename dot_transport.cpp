@@ -0,0 +1,179 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "dot_transport.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <openssl/err.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/epoll.h>
+
+static const size_t DOT_MAX_EVENTS = 64;
+
+DotTransport::Session::Session()
+    : ssl_{nullptr}, alive_{false}, rbuf_(16384), rpos_{0}, rlen_{0} {}
+
+DotTransport::Session::~Session() {
+  if (ssl_ != nullptr) {
+    SSL_free(ssl_);
+  }
+}
+
+size_t DotTransport::Session::extract(uint8_t *buffer, size_t maxlen) {
+  while (rlen_ - rpos_ >= 2) {
+    size_t msglen = (rbuf_[rpos_] << 8) | rbuf_[rpos_ + 1];
+    if (rlen_ - rpos_ < 2 + msglen) {
+      break;
+    }
+    size_t n = std::min(msglen, maxlen);
+    memcpy(buffer, &rbuf_[rpos_ + 2], n);
+    rpos_ += 2 + msglen;
+    if (rpos_ == rlen_) {
+      rpos_ = rlen_ = 0;
+    }
+    if (n > 0) {
+      return n;
+    }
+  }
+  return 0;
+}
+
+DotTransport::DotTransport(const struct sockaddr_in &server,
+                           struct timeval timeout, uint32_t num_sessions,
+                           bool resumption)
+    : TlsTransport{server, timeout, resumption, nullptr, 0}, next_{0} {
+  if (num_sessions == 0) {
+    throw TransportException{"At least one TLS session is needed."};
+  }
+  /* Establish the sessions */
+  for (uint32_t i = 0; i < num_sessions; i++) {
+    sessions_.emplace_back(new Session{});
+    Session &session = *sessions_.back();
+    session.ssl_ = connect(session.sock_);
+    session.alive_ = true;
+    if (resumption_ && i + 1 < num_sessions) {
+      session.rlen_ = await_ticket(session.sock_, session.ssl_,
+                                   session.rbuf_.data(), session.rbuf_.size());
+    }
+    watch(session.sock_, i);
+  }
+}
+
+void DotTransport::send(const uint8_t *data, size_t len) {
+  uint8_t frame[2 + 65535];
+  frame[0] = (len >> 8) & 0xff;
+  frame[1] = len & 0xff;
+  memcpy(frame + 2, data, len);
+  for (size_t tries = 0; tries < sessions_.size(); tries++) {
+    Session &session = *sessions_[next_++ % sessions_.size()];
+    std::unique_lock<std::mutex> lock{session.m_};
+    size_t sent = 0;
+    while (session.alive_) {
+      int ret = SSL_write(session.ssl_, frame + sent, (int)(len + 2 - sent));
+      if (ret > 0) {
+        sent += ret;
+        if (sent == len + 2) {
+          return;
+        }
+        continue;
+      }
+      int err = SSL_get_error(session.ssl_, ret);
+      if (err != SSL_ERROR_WANT_WRITE && err != SSL_ERROR_WANT_READ) {
+        ERR_clear_error();
+        break;
+      }
+      /* Let the receiver drain the session while waiting for buffer space */
+      lock.unlock();
+      struct pollfd pfd;
+      pfd.fd = session.sock_;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      ::poll(&pfd, 1, 10);
+      lock.lock();
+    }
+  }
+  send_errors_++;
+  std::cerr << "Can't send packet." << std::endl;
+}
+
+void DotTransport::read_available(Session &session) {
+  std::lock_guard<std::mutex> lock{session.m_};
+  while (session.alive_) {
+    /* Make room in the buffer */
+    if (session.rbuf_.size() - session.rlen_ < 4096) {
+      if (session.rpos_ > 0) {
+        memmove(session.rbuf_.data(), session.rbuf_.data() + session.rpos_,
+                session.rlen_ - session.rpos_);
+        session.rlen_ -= session.rpos_;
+        session.rpos_ = 0;
+      }
+      if (session.rbuf_.size() - session.rlen_ < 4096) {
+        session.rbuf_.resize(session.rbuf_.size() * 2);
+      }
+    }
+    int ret = SSL_read(session.ssl_, session.rbuf_.data() + session.rlen_,
+                       (int)(session.rbuf_.size() - session.rlen_));
+    if (ret > 0) {
+      session.rlen_ += ret;
+      continue;
+    }
+    int err = SSL_get_error(session.ssl_, ret);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+      break;
+    }
+    /* The session is closed or broken */
+    ERR_clear_error();
+    session.alive_ = false;
+    disconnects_++;
+    ::epoll_ctl(epoll_, EPOLL_CTL_DEL, session.sock_, nullptr);
+  }
+}
+
+ssize_t DotTransport::receive(uint8_t *buffer, size_t maxlen) {
+  struct epoll_event events[DOT_MAX_EVENTS];
+  for (;;) {
+    /* Return the already buffered messages first */
+    while (!ready_.empty()) {
+      size_t len = sessions_[ready_.back()]->extract(buffer, maxlen);
+      if (len > 0) {
+        return len;
+      }
+      ready_.pop_back();
+    }
+    int n = ::epoll_wait(epoll_, events, DOT_MAX_EVENTS, timeout_ms());
+    if (n == 0) {
+      errno = EWOULDBLOCK;
+      return -1;
+    } else if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    for (int i = 0; i < n; i++) {
+      read_available(*sessions_[events[i].data.u64]);
+      ready_.push_back(events[i].data.u64);
+    }
+  }
+}
@@ -0,0 +1,96 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the DNS over TLS transport
+ */
+
+#ifndef DOT_TRANSPORT_H_INCLUDED_
+#define DOT_TRANSPORT_H_INCLUDED_
+
+#include "tls_transport.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Class for sending queries over DNS over TLS (RFC 7858).
+ * The queries are distributed round-robin over a number of concurrent TLS
+ * sessions and pipelined without waiting for the answers.
+ * The sessions are established in the constructor, so the handshakes are not
+ * part of the measured query traffic. If resumption is enabled, only the
+ * first session does a full handshake, every further session resumes the
+ * ticket received on the previous one.
+ */
+class DotTransport : public TlsTransport {
+private:
+  /**
+   * Class to represent one TLS session.
+   */
+  struct Session {
+    Socket sock_;               /**< TCP socket of the session */
+    SSL *ssl_;                  /**< OpenSSL connection object */
+    std::mutex m_;              /**< Mutex for accessing ssl_ */
+    bool alive_;                /**< Flag to mark whether it is usable */
+    std::vector<uint8_t> rbuf_; /**< Buffer of the received stream */
+    size_t rpos_;               /**< Read position in rbuf_ */
+    size_t rlen_;               /**< Amount of valid data in rbuf_ */
+
+    Session();
+    ~Session();
+
+    /**
+     * Extracts one length-prefixed DNS message from the receive buffer.
+     * @param buffer the buffer to copy the message to
+     * @param maxlen the length of the buffer
+     * @return length of the message, or 0 if no complete message is buffered
+     */
+    size_t extract(uint8_t *buffer, size_t maxlen);
+  };
+
+  std::vector<std::unique_ptr<Session>> sessions_; /**< TLS sessions */
+  std::atomic<size_t> next_;  /**< Next session to send on */
+  std::vector<size_t> ready_; /**< Sessions with possibly buffered data */
+
+  /**
+   * Reads everything available from a session into its buffer.
+   * @param session the session to read
+   */
+  void read_available(Session &session);
+
+public:
+  /**
+   * Constructor.
+   * @param server address of the server
+   * @param timeout receive timeout
+   * @param num_sessions number of concurrent TLS sessions
+   * @param resumption whether to resume session tickets
+   */
+  DotTransport(const struct sockaddr_in &server, struct timeval timeout,
+               uint32_t num_sessions, bool resumption);
+
+  void send(const uint8_t *data, size_t len) override;
+
+  ssize_t receive(uint8_t *buffer, size_t maxlen) override;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "histogram.h"
+#include <algorithm>
+#include <cmath>
+
+static const unsigned HISTOGRAM_SUB_BITS = 4;
+static const size_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+static const size_t HISTOGRAM_BUCKETS =
+    (64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+Histogram::Histogram()
+    : buckets_(HISTOGRAM_BUCKETS, 0), count_{0}, min_{UINT64_MAX}, max_{0},
+      sum_{0} {}
+
+size_t Histogram::bucket(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  unsigned shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS +
+         ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::bucket_max(size_t index) {
+  if (index < HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+  unsigned shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t sub = index % HISTOGRAM_SUB_BUCKETS;
+  return ((HISTOGRAM_SUB_BUCKETS + sub) << shift) + ((1ULL << shift) - 1);
+}
+
+void Histogram::add(uint64_t value) {
+  buckets_[bucket(value)]++;
+  count_++;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+  sum_ += value;
+}
+
+Histogram &Histogram::operator+=(const Histogram &rhs) {
+  for (size_t i = 0; i < buckets_.size(); i++) {
+    buckets_[i] += rhs.buckets_[i];
+  }
+  count_ += rhs.count_;
+  min_ = std::min(min_, rhs.min_);
+  max_ = std::max(max_, rhs.max_);
+  sum_ += rhs.sum_;
+  return *this;
+}
+
+void Histogram::clear() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  min_ = UINT64_MAX;
+  max_ = 0;
+  sum_ = 0;
+}
+
+uint64_t Histogram::count() const { return count_; }
+
+uint64_t Histogram::min() const { return count_ > 0 ? min_ : 0; }
+
+uint64_t Histogram::max() const { return max_; }
+
+double Histogram::mean() const { return count_ > 0 ? sum_ / count_ : 0; }
+
+uint64_t Histogram::percentile(double p) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  uint64_t rank = std::max((uint64_t)1, (uint64_t)ceil(p / 100.0 * count_));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets_.size(); i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::min(bucket_max(i), max_);
+    }
+  }
+  return max_;
+}
@@ -0,0 +1,119 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for a log-linear histogram
+ */
+
+#ifndef HISTOGRAM_H_INCLUDED_
+#define HISTOGRAM_H_INCLUDED_
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Class to represent a log-linear histogram of non-negative values.
+ * Every power of two is split into 16 equal buckets, so the recorded values
+ * are kept with a relative error below 6.25% in constant memory, and adding
+ * a value is O(1) without allocation.
+ */
+class Histogram {
+private:
+  std::vector<uint64_t> buckets_; /**< Number of values in each bucket */
+  uint64_t count_;                /**< Number of values */
+  uint64_t min_;                  /**< Smallest value */
+  uint64_t max_;                  /**< Largest value */
+  double sum_;                    /**< Sum of the values */
+
+  friend class ControlMessage;
+
+  /**
+   * Returns the bucket of a value.
+   * @param value the value
+   * @return index of the bucket
+   */
+  static size_t bucket(uint64_t value);
+
+  /**
+   * Returns the largest value that falls into a bucket.
+   * @param index index of the bucket
+   * @return the value
+   */
+  static uint64_t bucket_max(size_t index);
+
+public:
+  /**
+   * Constructor.
+   */
+  Histogram();
+
+  /**
+   * Records a value.
+   * @param value the value
+   */
+  void add(uint64_t value);
+
+  /**
+   * Merges another histogram into this one.
+   * @param rhs the histogram to merge
+   * @return reference to this
+   */
+  Histogram &operator+=(const Histogram &rhs);
+
+  /**
+   * Removes all recorded values.
+   */
+  void clear();
+
+  /**
+   * Getter for the number of values.
+   * @return the number of values
+   */
+  uint64_t count() const;
+
+  /**
+   * Getter for the smallest value.
+   * @return the smallest value, or 0 if empty
+   */
+  uint64_t min() const;
+
+  /**
+   * Getter for the largest value.
+   * @return the largest value
+   */
+  uint64_t max() const;
+
+  /**
+   * Calculates the average of the values.
+   * @return the average, or 0 if empty
+   */
+  double mean() const;
+
+  /**
+   * Calculates a percentile of the values.
+   * @param p the percentile, between 0 and 100
+   * @return the upper bound of the bucket containing the percentile
+   */
+  uint64_t percentile(double p) const;
+};
+
+#endif
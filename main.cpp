@@ -19,126 +19,490 @@
  * USA.
  */
 
+#include "control.h"
 #include "dnstester.h"
+#include "scenario.h"
+#include "timer_accuracy.h"
 #include <arpa/inet.h>
+#include <cerrno>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <getopt.h>
 #include <iostream>
 #include <memory>
 #include <net/if.h>
+#include <sched.h>
+#include <signal.h>
+#include <sstream>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <thread>
+#include <vector>
 
 int main(int argc, char *argv[]) {
   struct in_addr server_addr;
   uint16_t port;
   uint32_t ip;
   uint8_t netmask;
-  uint32_t num_req, num_burst, num_thread;
+  uint64_t num_req;
+  uint32_t num_burst, num_thread;
   uint64_t burst_delay;
   struct timeval timeout;
-  if (argc < 9) {
-    std::cerr << "Usage: dns64perf++ <server> <port> <subnet> <number of "
-                 "requests> <burst size> <number of threads> <delay between "
-                 "bursts in ns> <timeout in s>"
-              << std::endl;
-    return -1;
-  }
-  /* Server address */
-  if (inet_pton(AF_INET, argv[1], reinterpret_cast<void *>(&server_addr)) !=
-      1) {
-    std::cerr << "Bad server adddress." << std::endl;
-    return -1;
-  }
-  /* Port */
-  if (sscanf(argv[2], "%hu", &port) != 1) {
-    std::cerr << "Bad port." << std::endl;
-    return -1;
-  }
-  /* Subnet */
-  uint8_t temp[4];
-  if (sscanf(argv[3], "%hhu.%hhu.%hhu.%hhu/%hhu", temp, temp + 1, temp + 2,
-             temp + 3, &netmask) != 5) {
-    std::cerr << "Bad subnet." << std::endl;
-    return -1;
+  TesterOptions options;
+  uint16_t agent_port = 0;
+  std::vector<struct sockaddr_in> agents;
+  std::vector<int> cpus;
+  const char *scenario_file = nullptr;
+  bool timer_accuracy = false;
+  bool per_tester = false;
+  /* Options */
+  static const struct option long_options[] = {
+      {"transport", required_argument, nullptr, 't'},
+      {"tls-sessions", required_argument, nullptr, 's'},
+      {"no-tls-resumption", no_argument, nullptr, 'R'},
+      {"h2-streams", required_argument, nullptr, 'm'},
+      {"doh-path", required_argument, nullptr, 'P'},
+      {"tcp-fastopen", no_argument, nullptr, 'F'},
+      {"tc-retry", no_argument, nullptr, 'T'},
+      {"retries", required_argument, nullptr, 'r'},
+      {"retry-interval", required_argument, nullptr, 'i'},
+      {"retry-backoff", required_argument, nullptr, 'b'},
+      {"epoch", required_argument, nullptr, 'E'},
+      {"duration", required_argument, nullptr, 'D'},
+      {"warm-up", required_argument, nullptr, 'W'},
+      {"concurrency", required_argument, nullptr, 'L'},
+      {"slo", required_argument, nullptr, 'O'},
+      {"pace", no_argument, nullptr, 'p'},
+      {"txtime", required_argument, nullptr, 'X'},
+      {"agent", required_argument, nullptr, 'A'},
+      {"coordinate", required_argument, nullptr, 'C'},
+      {"cpus", required_argument, nullptr, 'c'},
+      {"scenario", required_argument, nullptr, 'S'},
+      {"timer-accuracy", no_argument, nullptr, 'a'},
+      {"perf-counters", no_argument, nullptr, 'H'},
+      {"per-tester", no_argument, nullptr, 'B'},
+      {nullptr, 0, nullptr, 0}};
+  int opt;
+  while ((opt = getopt_long(argc, argv, "t:s:Rm:P:FTr:i:b:E:D:W:L:O:pX:A:C:c:S:aHB", long_options, nullptr)) !=
+         -1) {
+    switch (opt) {
+    case 't':
+      if (strcmp(optarg, "udp") == 0) {
+        options.transport_ = TransportType::UDP;
+      } else if (strcmp(optarg, "tcp") == 0) {
+        options.transport_ = TransportType::TCP;
+      } else if (strcmp(optarg, "dot") == 0) {
+        options.transport_ = TransportType::DoT;
+      } else if (strcmp(optarg, "doh") == 0) {
+        options.transport_ = TransportType::DoH;
+      } else {
+        std::cerr << "Bad transport, must be udp, tcp, dot or doh." << std::endl;
+        return -1;
+      }
+      break;
+    case 's':
+      if (sscanf(optarg, "%u", &options.tls_sessions_) != 1 ||
+          options.tls_sessions_ == 0) {
+        std::cerr << "Bad number of TLS sessions." << std::endl;
+        return -1;
+      }
+      break;
+    case 'R':
+      options.tls_resumption_ = false;
+      break;
+    case 'm':
+      if (sscanf(optarg, "%u", &options.h2_streams_) != 1 ||
+          options.h2_streams_ == 0) {
+        std::cerr << "Bad number of HTTP/2 streams." << std::endl;
+        return -1;
+      }
+      break;
+    case 'P':
+      options.doh_path_ = optarg;
+      break;
+    case 'F':
+      options.tcp_fastopen_ = true;
+      break;
+    case 'T':
+      options.tc_retry_ = true;
+      break;
+    case 'r':
+      if (sscanf(optarg, "%u", &options.retries_) != 1 ||
+          options.retries_ > UINT8_MAX) {
+        std::cerr << "Bad number of retries, must be between 0 and 255."
+                  << std::endl;
+        return -1;
+      }
+      break;
+    case 'i': {
+      double retry_interval;
+      if (sscanf(optarg, "%lf", &retry_interval) != 1 ||
+          retry_interval <= 0) {
+        std::cerr << "Bad retry interval." << std::endl;
+        return -1;
+      }
+      options.retry_interval_ =
+          std::chrono::nanoseconds{(int64_t)(retry_interval * 1000000000)};
+      break;
+    }
+    case 'b':
+      if (sscanf(optarg, "%lf", &options.retry_backoff_) != 1 ||
+          options.retry_backoff_ < 1) {
+        std::cerr << "Bad retry backoff, must be at least 1." << std::endl;
+        return -1;
+      }
+      break;
+    case 'E':
+      if (sscanf(optarg, "%lu", &options.first_epoch_) != 1) {
+        std::cerr << "Bad epoch." << std::endl;
+        return -1;
+      }
+      options.epoch_label_ = true;
+      break;
+    case 'D': {
+      double duration;
+      if (sscanf(optarg, "%lf", &duration) != 1 || duration <= 0) {
+        std::cerr << "Bad duration." << std::endl;
+        return -1;
+      }
+      options.duration_ =
+          std::chrono::nanoseconds{(int64_t)(duration * 1000000000)};
+      break;
+    }
+    case 'W': {
+      /* A number of queries, or a time with an s suffix */
+      double warmup;
+      char unit, rest;
+      if (sscanf(optarg, "%lf%c%c", &warmup, &unit, &rest) == 2 &&
+          unit == 's' && warmup > 0) {
+        options.warmup_queries_ = 0;
+        options.warmup_duration_ =
+            std::chrono::nanoseconds{(int64_t)(warmup * 1000000000)};
+      } else if (sscanf(optarg, "%lu%c", &options.warmup_queries_, &rest) ==
+                 1) {
+        options.warmup_duration_ = std::chrono::nanoseconds{0};
+      } else {
+        std::cerr << "Bad warm-up, must be a number of queries or a time in "
+                     "seconds followed by s."
+                  << std::endl;
+        return -1;
+      }
+      break;
+    }
+    case 'L':
+      if (sscanf(optarg, "%u", &options.concurrency_) != 1 ||
+          options.concurrency_ == 0) {
+        std::cerr << "Bad concurrency, must be between 1 and 2^32."
+                  << std::endl;
+        return -1;
+      }
+      break;
+    case 'O': {
+      /* 99th percentile in ms and an optional loss in percent */
+      double latency, loss = 0;
+      char rest;
+      int n = sscanf(optarg, "%lf,%lf%c", &latency, &loss, &rest);
+      if ((n != 1 && n != 2) || latency <= 0 || loss < 0 || loss > 100) {
+        std::cerr << "Bad objective, must be the 99th percentile of the "
+                     "round-trip time in ms and optionally the timed out "
+                     "queries in percent, e.g. 5,0.1."
+                  << std::endl;
+        return -1;
+      }
+      options.slo_latency_ =
+          std::chrono::nanoseconds{(int64_t)(latency * 1000000)};
+      options.slo_loss_ = loss / 100;
+      break;
+    }
+    case 'p':
+      options.pace_ = true;
+      break;
+    case 'X':
+      if (strcmp(optarg, "tai") == 0) {
+        options.txtime_clock_ = CLOCK_TAI;
+      } else if (strcmp(optarg, "monotonic") == 0) {
+        options.txtime_clock_ = CLOCK_MONOTONIC;
+      } else {
+        std::cerr << "Bad txtime clock, must be tai or monotonic."
+                  << std::endl;
+        return -1;
+      }
+      break;
+    case 'A':
+      if (sscanf(optarg, "%hu", &agent_port) != 1 || agent_port == 0) {
+        std::cerr << "Bad agent port." << std::endl;
+        return -1;
+      }
+      break;
+    case 'C': {
+      /* Comma separated list of address:port */
+      std::stringstream list{optarg};
+      std::string item;
+      while (std::getline(list, item, ',')) {
+        struct sockaddr_in agent;
+        memset(&agent, 0x00, sizeof(agent));
+        agent.sin_family = AF_INET;
+        size_t colon = item.rfind(':');
+        uint16_t agent_port;
+        if (colon == std::string::npos ||
+            inet_pton(AF_INET, item.substr(0, colon).c_str(),
+                      reinterpret_cast<void *>(&agent.sin_addr)) != 1 ||
+            sscanf(item.c_str() + colon + 1, "%hu", &agent_port) != 1) {
+          std::cerr << "Bad agent, must be address:port." << std::endl;
+          return -1;
+        }
+        agent.sin_port = htons(agent_port);
+        agents.push_back(agent);
+      }
+      if (agents.empty()) {
+        std::cerr << "Bad list of agents." << std::endl;
+        return -1;
+      }
+      break;
+    }
+    case 'c': {
+      /* Comma separated list of CPUs and ranges of CPUs */
+      std::stringstream list{optarg};
+      std::string item;
+      cpu_set_t available;
+      CPU_ZERO(&available);
+      sched_getaffinity(0, sizeof(available), &available);
+      while (std::getline(list, item, ',')) {
+        char *end;
+        long from = strtol(item.c_str(), &end, 10), to = from;
+        if (end != item.c_str() && *end == '-') {
+          to = strtol(end + 1, &end, 10);
+        }
+        if (end == item.c_str() || *end != '\0' || from < 0 || to < from ||
+            to >= CPU_SETSIZE) {
+          std::cerr << "Bad list of CPUs." << std::endl;
+          return -1;
+        }
+        for (int cpu = from; cpu <= to; cpu++) {
+          if (!CPU_ISSET(cpu, &available)) {
+            std::cerr << "CPU " << cpu << " is not available." << std::endl;
+            return -1;
+          }
+          cpus.push_back(cpu);
+        }
+      }
+      if (cpus.empty()) {
+        std::cerr << "Bad list of CPUs." << std::endl;
+        return -1;
+      }
+      break;
+    }
+    case 'S':
+      scenario_file = optarg;
+      break;
+    case 'a':
+      timer_accuracy = true;
+      break;
+    case 'H':
+      options.perf_counters_ = true;
+      break;
+    case 'B':
+      per_tester = true;
+      break;
+    default:
+      return -1;
+    }
   }
-  if (netmask > 32) {
-    std::cerr << "Bad netmask." << std::endl;
+  /* A DUT closing a TLS session must not kill the tester */
+  signal(SIGPIPE, SIG_IGN);
+  if (agent_port != 0) {
+    /* The coordinator sends every parameter of the tests */
+    try {
+      Agent agent{agent_port, cpus};
+      agent.serve();
+    } catch (std::exception &e) {
+      std::cerr << e.what() << std::endl;
+    }
     return -1;
   }
-  ip = ((temp[0] << 24) | (temp[1] << 16) | (temp[2] << 8) | temp[3]) &
-       ~(((uint64_t)1 << (32 - netmask)) - 1);
-  /* Number of requests */
-  if (sscanf(argv[4], "%u", &num_req) != 1) {
-    std::cerr << "Bad number of requests, must be between 0 and 2^32."
-              << std::endl;
-    return -1;
+  if (timer_accuracy) {
+    /* Characterizes this host instead of testing a DUT */
+    try {
+      TimerAccuracy accuracy{cpus};
+      accuracy.run();
+    } catch (std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return -1;
+    }
+    return 0;
   }
-  if (num_req > ((uint64_t)1 << (32 - netmask))) {
-    std::cerr << "The number of requests is higher than the avaliable IPs in "
-                 "the subnet."
+  if (options.tc_retry_ && options.transport_ != TransportType::UDP) {
+    std::cerr << "Retrying truncated answers requires the udp transport."
               << std::endl;
     return -1;
   }
-  /* Burst size */
-  if (sscanf(argv[5], "%u", &num_burst) != 1) {
-    std::cerr << "Bad burst size, must be between 0 and 2^32." << std::endl;
+  if (options.retries_ > 0 && options.transport_ != TransportType::UDP) {
+    /* The receiver retransmits, and only the UDP transport can be sent on by
+     * both threads without waiting for the receiver */
+    std::cerr << "Retransmissions require the udp transport." << std::endl;
     return -1;
   }
-  /* Number of threads */
-  if (sscanf(argv[6], "%u", &num_thread) != 1) {
-    std::cerr << "Bad number of threads size, must be between 0 and 2^32."
+  if (options.slo_latency_.count() > 0 && options.concurrency_ > 0) {
+    std::cerr << "The rate controller requires sending bursts on a timer, "
+                 "not the closed-loop mode."
               << std::endl;
     return -1;
   }
-  /* Sanity check */
-  if (num_req % (num_thread * num_burst) != 0) {
-    std::cerr << "Number of requests must be divisble by (number of threads * "
-                 "burst size)"
+  if (options.txtime_clock_ >= 0 &&
+      (options.transport_ != TransportType::UDP || options.concurrency_ > 0)) {
+    std::cerr << "Launch times require the udp transport and sending bursts "
+                 "on a timer."
               << std::endl;
     return -1;
   }
-  /* Burst delay */
-  if (sscanf(argv[7], "%lu", &burst_delay) != 1) {
-    std::cerr << "Bad delay between bursts." << std::endl;
-    return -1;
-  }
-  /* Timeout */
-  double timeout_, s, us;
-  if (sscanf(argv[8], "%lf", &timeout_) != 1) {
-    std::cerr << "Bad timeout." << std::endl;
+  if (options.perf_counters_ && !PerfCounters{}.available()) {
+    std::cerr << "Cannot open any performance counter: " << strerror(errno)
+              << ", see /proc/sys/kernel/perf_event_paranoid." << std::endl;
     return -1;
   }
-  us = modf(timeout_, &s) * 1000000;
-  timeout.tv_sec = (time_t)s;
-  timeout.tv_usec = (suseconds_t)us;
+  TestSetup setup;
+  setup.options_ = options;
+  setup.cpus_ = cpus;
+  std::vector<Phase> phases;
+  if (scenario_file != nullptr) {
+    if (argc > optind) {
+      std::cerr << "The parameters of a scenario are given in its file."
+                << std::endl;
+      return -1;
+    }
+    try {
+      Scenario scenario{scenario_file, setup};
+      phases = scenario.phases();
+    } catch (std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return -1;
+    }
+  } else {
+    if (argc - optind < 8) {
+      std::cerr << "Usage: dns64perf++ [options] <server> <port> <subnet> "
+                   "<number of requests> <burst size> <number of threads> "
+                   "<delay between bursts in ns> <timeout in s>"
+                << std::endl;
+      return -1;
+    }
+    argv += optind - 1;
+    /* Server address */
+    if (inet_pton(AF_INET, argv[1], reinterpret_cast<void *>(&server_addr)) !=
+        1) {
+      std::cerr << "Bad server adddress." << std::endl;
+      return -1;
+    }
+    /* Port */
+    if (sscanf(argv[2], "%hu", &port) != 1) {
+      std::cerr << "Bad port." << std::endl;
+      return -1;
+    }
+    /* Subnet */
+    uint8_t temp[4];
+    if (sscanf(argv[3], "%hhu.%hhu.%hhu.%hhu/%hhu", temp, temp + 1, temp + 2,
+               temp + 3, &netmask) != 5) {
+      std::cerr << "Bad subnet." << std::endl;
+      return -1;
+    }
+    if (netmask > 32) {
+      std::cerr << "Bad netmask." << std::endl;
+      return -1;
+    }
+    ip = ((temp[0] << 24) | (temp[1] << 16) | (temp[2] << 8) | temp[3]) &
+         ~(((uint64_t)1 << (32 - netmask)) - 1);
+    /* Number of requests */
+    if (sscanf(argv[4], "%lu", &num_req) != 1) {
+      std::cerr << "Bad number of requests, must be between 0 and 2^64."
+                << std::endl;
+      return -1;
+    }
+    if (options.duration_.count() > 0 && num_req == 0) {
+      /* No limit but the available names */
+      num_req =
+          options.epoch_label_ ? UINT64_MAX : (uint64_t)1 << (32 - netmask);
+    }
+    if (!options.epoch_label_ && num_req > ((uint64_t)1 << (32 - netmask))) {
+      std::cerr << "The number of requests is higher than the avaliable IPs in "
+                   "the subnet, use --epoch for more names."
+                << std::endl;
+      return -1;
+    }
+    /* Burst size */
+    if (sscanf(argv[5], "%u", &num_burst) != 1 || num_burst == 0) {
+      std::cerr << "Bad burst size, must be between 1 and 2^32." << std::endl;
+      return -1;
+    }
+    /* Number of threads */
+    if (sscanf(argv[6], "%u", &num_thread) != 1 || num_thread == 0) {
+      std::cerr << "Bad number of threads size, must be between 1 and 2^32."
+                << std::endl;
+      return -1;
+    }
+    /* Burst delay */
+    if (sscanf(argv[7], "%lu", &burst_delay) != 1) {
+      std::cerr << "Bad delay between bursts." << std::endl;
+      return -1;
+    }
+    /* Timeout */
+    double timeout_, s, us;
+    if (sscanf(argv[8], "%lf", &timeout_) != 1) {
+      std::cerr << "Bad timeout." << std::endl;
+      return -1;
+    }
+    us = modf(timeout_, &s) * 1000000;
+    timeout.tv_sec = (time_t)s;
+    timeout.tv_usec = (suseconds_t)us;
 
-  std::vector<std::unique_ptr<DnsTester>> testers;
-  std::vector<std::thread> threads;
-  auto reference_time =
-      std::chrono::high_resolution_clock::now() + std::chrono::seconds(2);
-  for (uint32_t i = 0; i < num_thread; i++) {
-    testers.emplace_back(std::make_unique<DnsTester>(
-        server_addr, port, ip, netmask, num_req, num_burst, num_thread, i,
-        reference_time + std::chrono::nanoseconds{burst_delay / num_thread} * i,
-        std::chrono::nanoseconds{burst_delay}, timeout));
+    setup.server_addr_ = server_addr;
+    setup.port_ = port;
+    setup.ip_ = ip;
+    setup.netmask_ = netmask;
+    setup.num_req_ = num_req;
+    setup.num_burst_ = num_burst;
+    setup.num_thread_ = num_thread;
+    setup.burst_delay_ = burst_delay;
+    setup.timeout_ = timeout;
+    phases.push_back(Phase{"", setup});
   }
   try {
-    for (uint32_t i = 0; i < num_thread; i++) {
-      threads.emplace_back([&, i]() { testers[i]->start(); });
-      pthread_setname_np(threads.back().native_handle(),
-                         ("Receiver " + std::to_string(i)).c_str());
+    /* The connections to the agents are kept for every phase */
+    std::unique_ptr<Coordinator> coordinator;
+    if (!agents.empty()) {
+      coordinator.reset(new Coordinator{agents});
     }
-    for (uint32_t i = 0; i < num_thread; i++) {
-      threads[i].join();
+    /* The connections to the DUT are kept while the phases use the same
+     * transport and threads, the agents decide the same on their own */
+    std::vector<std::unique_ptr<Transport>> transports;
+    const TestSetup *previous = nullptr;
+    for (const auto &phase : phases) {
+      std::vector<std::unique_ptr<DnsTester>> testers;
+      if (!phase.name_.empty()) {
+        printf("Phase %s\n", phase.name_.c_str());
+        fflush(stdout);
+      }
+      if (previous == nullptr || !phase.setup_.same_transport(*previous)) {
+        transports.clear();
+      }
+      previous = &phase.setup_;
+      if (coordinator) {
+        testers = coordinator->run(phase.setup_);
+      } else {
+        testers = phase.setup_.run(
+            0, phase.setup_.num_thread_,
+            []() {
+              return std::chrono::high_resolution_clock::now() + START_DELAY;
+            },
+            transports);
+      }
+      DnsTesterAggregator aggregator(testers, per_tester);
+      aggregator.display();
+      aggregator.write(phase.name_.empty()
+                           ? "dns64perf.csv"
+                           : ("dns64perf-" + phase.name_ + ".csv").c_str());
     }
-    DnsTesterAggregator aggregator(testers);
-    aggregator.display();
-    aggregator.write("dns64perf.csv");
   } catch (std::exception &e) {
     std::cerr << e.what() << std::endl;
   }
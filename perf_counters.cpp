@@ -0,0 +1,115 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "perf_counters.h"
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+PerfCounts::PerfCounts()
+    : cycles_{-1}, instructions_{-1}, cache_misses_{-1},
+      context_switches_{-1}, page_faults_{-1} {}
+
+/**
+ * Opens a counter of the calling thread, stopped.
+ * @param type the type of the event
+ * @param config the event
+ * @return the counter, or -1 if the event is not available
+ */
+static int open_counter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0x00, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  /* The system calls are part of the cost of a query, when allowed */
+  int fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd == -1 && (errno == EACCES || errno == EPERM)) {
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  return fd;
+}
+
+PerfCounters::PerfCounters() {
+  fds_[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  fds_[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  fds_[2] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  fds_[3] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+  fds_[4] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds_) {
+    if (fd != -1) {
+      ::close(fd);
+    }
+  }
+}
+
+bool PerfCounters::available() const {
+  for (int fd : fds_) {
+    if (fd != -1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PerfCounters::start() {
+  for (int fd : fds_) {
+    if (fd != -1) {
+      ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+PerfCounts PerfCounters::read() const {
+  int64_t values[NUM_EVENTS];
+  for (size_t i = 0; i < NUM_EVENTS; i++) {
+    /* Value, time enabled and time running */
+    uint64_t data[3];
+    values[i] = -1;
+    if (fds_[i] == -1 ||
+        ::read(fds_[i], data, sizeof(data)) != (ssize_t)sizeof(data)) {
+      continue;
+    }
+    if (data[2] > 0 && data[2] < data[1]) {
+      data[0] = (uint64_t)((double)data[0] * data[1] / data[2]);
+    }
+    values[i] = (int64_t)data[0];
+  }
+  PerfCounts counts;
+  counts.cycles_ = values[0];
+  counts.instructions_ = values[1];
+  counts.cache_misses_ = values[2];
+  counts.context_switches_ = values[3];
+  counts.page_faults_ = values[4];
+  return counts;
+}
@@ -0,0 +1,87 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the hardware performance counters of a thread
+ */
+
+#ifndef PERF_COUNTERS_H_INCLUDED_
+#define PERF_COUNTERS_H_INCLUDED_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Class to store the events counted in a thread
+ */
+struct PerfCounts {
+  int64_t cycles_;           /**< CPU cycles, or -1 if not available */
+  int64_t instructions_;     /**< Retired instructions, or -1 */
+  int64_t cache_misses_;     /**< Last level cache misses, or -1 */
+  int64_t context_switches_; /**< Context switches, or -1 */
+  int64_t page_faults_;      /**< Page faults, or -1 */
+
+  PerfCounts();
+};
+
+/**
+ * Class to count the events of the calling thread with perf_event_open.
+ * The counters the kernel or the CPU does not support are left out, so
+ * the software events are counted in a virtual machine too.
+ */
+class PerfCounters {
+private:
+  static const size_t NUM_EVENTS = 5; /**< Number of counted events */
+  int fds_[NUM_EVENTS]; /**< Counters in the order of PerfCounts, or -1 */
+
+public:
+  /**
+   * Constructor, opens the counters of the calling thread, stopped.
+   */
+  PerfCounters();
+
+  /**
+   * Destructor, closes the counters.
+   */
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  /**
+   * Checks whether any counter could be opened.
+   * @return true if at least one event is counted
+   */
+  bool available() const;
+
+  /**
+   * Starts counting from zero.
+   */
+  void start();
+
+  /**
+   * Reads the counters, scaled if the kernel multiplexed them.
+   * @return the counts since start
+   */
+  PerfCounts read() const;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "rate_controller.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+RateController::RateController(
+    const std::vector<std::unique_ptr<DnsTester>> &testers, uint32_t num_burst,
+    uint64_t burst_delay, const TesterOptions &options)
+    : testers_(testers), slo_latency_{options.slo_latency_},
+      slo_loss_{options.slo_loss_},
+      burst_queries_{(double)testers.size() * num_burst},
+      rate_{burst_queries_ * 1000000000 / std::max(burst_delay, (uint64_t)1)},
+      step_{rate_ * RATE_INCREASE}, best_{0} {}
+
+void RateController::run(std::chrono::high_resolution_clock::time_point start,
+                         std::function<bool()> finished) {
+  auto window_end = start + RATE_WINDOW;
+  for (;;) {
+    std::this_thread::sleep_until(window_end);
+    bool done = finished();
+    for (const auto &tester : testers_) {
+      done = done || tester->sending_done();
+    }
+    if (done) {
+      break;
+    }
+    Histogram rtt;
+    uint64_t lost = 0;
+    for (const auto &tester : testers_) {
+      lost += tester->window(rtt);
+    }
+    double seconds = std::chrono::duration<double>(window_end - start).count();
+    window_end += RATE_WINDOW;
+    if (rtt.count() + lost == 0) {
+      /* Nothing to judge, e.g. during the warm-up */
+      printf("Rate controller at %.1f s: %.0f queries/s, no results, hold\n",
+             seconds, rate_);
+      fflush(stdout);
+      continue;
+    }
+    double loss = (double)lost / (rtt.count() + lost);
+    bool met = rtt.count() > 0 &&
+               rtt.percentile(99) <= (uint64_t)slo_latency_.count() &&
+               loss <= slo_loss_;
+    printf("Rate controller at %.1f s: %.0f queries/s, p99 %.02f ms, timed "
+           "out %.02f%%, %s\n",
+           seconds, rate_, rtt.percentile(99) / 1000000.0, loss * 100,
+           met ? "increase" : "decrease");
+    fflush(stdout);
+    if (met) {
+      best_ = std::max(best_, rate_);
+      rate_ += step_;
+    } else {
+      rate_ = std::max(step_, rate_ * RATE_DECREASE);
+    }
+    for (const auto &tester : testers_) {
+      tester->reschedule(std::chrono::nanoseconds{
+          (int64_t)(burst_queries_ * 1000000000 / rate_)});
+    }
+  }
+  if (best_ > 0) {
+    printf("Highest rate meeting the objective: %.0f queries/s\n", best_);
+  } else {
+    printf("No rate met the objective\n");
+  }
+  fflush(stdout);
+}
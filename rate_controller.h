@@ -0,0 +1,82 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the rate controller of the testers
+ */
+
+#ifndef RATE_CONTROLLER_H_INCLUDED_
+#define RATE_CONTROLLER_H_INCLUDED_
+
+#include "dnstester.h"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+static const std::chrono::milliseconds RATE_WINDOW{
+    1000}; /**< Time between the adjustments of the rate */
+static const double RATE_INCREASE =
+    0.1; /**< Additive increase of the rate, relative to the initial rate */
+static const double RATE_DECREASE =
+    0.75; /**< Multiplicative decrease of the rate */
+
+/**
+ * Class to find the highest rate meeting a latency and loss objective.
+ * At the end of every window, the rate of the testers is increased by a
+ * constant step if the 99th percentile of the round-trip time of the answers
+ * and the ratio of the timed out queries of the window are within the
+ * objective, and decreased by a constant factor otherwise (AIMD).
+ */
+class RateController {
+private:
+  const std::vector<std::unique_ptr<DnsTester>> &testers_; /**< Testers */
+  std::chrono::nanoseconds slo_latency_; /**< Highest 99th percentile */
+  double slo_loss_;      /**< Highest ratio of timed out queries */
+  double burst_queries_; /**< Queries of a burst of every tester */
+  double rate_;          /**< Current rate in queries per second */
+  double step_;          /**< Additive increase of the rate */
+  double best_; /**< Highest rate of a window meeting the objective, or 0 */
+
+public:
+  /**
+   * Constructor.
+   * @param testers the testers of this process
+   * @param num_burst burst size
+   * @param burst_delay initial time between bursts in nanoseconds
+   * @param options the objective of the test
+   */
+  RateController(const std::vector<std::unique_ptr<DnsTester>> &testers,
+                 uint32_t num_burst, uint64_t burst_delay,
+                 const TesterOptions &options);
+
+  /**
+   * Adjusts the rate and prints it at the end of every window, until the
+   * testers have sent every query.
+   * @param start the start time of the test
+   * @param finished returns true if the testers have stopped
+   */
+  void run(std::chrono::high_resolution_clock::time_point start,
+           std::function<bool()> finished);
+};
+
+#endif
@@ -0,0 +1,398 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "scenario.h"
+#include <arpa/inet.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+ScenarioException::ScenarioException(std::string what) : what_{what} {}
+
+const char *ScenarioException::what() const noexcept { return what_.c_str(); }
+
+/**
+ * Removes the whitespace around a string.
+ * @param str the string
+ * @return the string without leading and trailing whitespace
+ */
+static std::string trim(const std::string &str) {
+  size_t begin = str.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  return str.substr(begin, str.find_last_not_of(" \t\r") - begin + 1);
+}
+
+/**
+ * Creates the exception of an error on a line.
+ * @param line line number in the file
+ * @param what the error
+ * @return the exception
+ */
+static ScenarioException error(unsigned line, const std::string &what) {
+  return ScenarioException{"Scenario line " + std::to_string(line) + ": " +
+                           what};
+}
+
+/**
+ * Reads a yes/no value.
+ * @param value the value
+ * @param line line number in the file
+ * @return true for yes
+ */
+static bool parse_bool(const std::string &value, unsigned line) {
+  if (value == "yes") {
+    return true;
+  } else if (value == "no") {
+    return false;
+  }
+  throw error(line, "bad value, must be yes or no.");
+}
+
+/**
+ * Converts seconds to nanoseconds.
+ * @param seconds the time in seconds
+ * @return the time in nanoseconds
+ */
+static std::chrono::nanoseconds to_nanoseconds(double seconds) {
+  return std::chrono::nanoseconds{(int64_t)(seconds * 1000000000)};
+}
+
+void Scenario::add(const std::string &name, unsigned line,
+                   const std::vector<Setting> &settings,
+                   const TestSetup &base) {
+  TestSetup setup = base;
+  TesterOptions &options = setup.options_;
+  bool has_server = false, has_subnet = false, has_requests = false,
+       has_delay = false, has_timeout = false;
+  double rate_from = 0, rate_to = 0;
+  unsigned steps = 1;
+  for (const auto &setting : settings) {
+    const std::string &key = setting.key_;
+    const char *value = setting.value_.c_str();
+    char rest;
+    if (key == "server") {
+      if (inet_pton(AF_INET, value,
+                    reinterpret_cast<void *>(&setup.server_addr_)) != 1) {
+        throw error(setting.line_, "bad server address.");
+      }
+      has_server = true;
+    } else if (key == "port") {
+      if (sscanf(value, "%hu %c", &setup.port_, &rest) != 1) {
+        throw error(setting.line_, "bad port.");
+      }
+    } else if (key == "subnet") {
+      uint8_t temp[4];
+      if (sscanf(value, "%hhu.%hhu.%hhu.%hhu/%hhu %c", temp, temp + 1,
+                 temp + 2, temp + 3, &setup.netmask_, &rest) != 5 ||
+          setup.netmask_ > 32) {
+        throw error(setting.line_, "bad subnet.");
+      }
+      setup.ip_ =
+          ((temp[0] << 24) | (temp[1] << 16) | (temp[2] << 8) | temp[3]) &
+          ~(((uint64_t)1 << (32 - setup.netmask_)) - 1);
+      has_subnet = true;
+    } else if (key == "requests") {
+      if (sscanf(value, "%lu %c", &setup.num_req_, &rest) != 1) {
+        throw error(setting.line_, "bad number of requests.");
+      }
+      has_requests = true;
+    } else if (key == "burst") {
+      if (sscanf(value, "%u %c", &setup.num_burst_, &rest) != 1 ||
+          setup.num_burst_ == 0) {
+        throw error(setting.line_, "bad burst size.");
+      }
+    } else if (key == "threads") {
+      if (sscanf(value, "%u %c", &setup.num_thread_, &rest) != 1 ||
+          setup.num_thread_ == 0) {
+        throw error(setting.line_, "bad number of threads.");
+      }
+    } else if (key == "delay") {
+      if (sscanf(value, "%lu %c", &setup.burst_delay_, &rest) != 1) {
+        throw error(setting.line_, "bad delay between bursts.");
+      }
+      has_delay = true;
+      rate_from = rate_to = 0;
+    } else if (key == "rate") {
+      int n = sscanf(value, "%lf - %lf %c", &rate_from, &rate_to, &rest);
+      if (n == 1) {
+        rate_to = rate_from;
+      }
+      if ((n != 1 && n != 2) || rate_from <= 0 || rate_to <= 0) {
+        throw error(setting.line_, "bad rate.");
+      }
+    } else if (key == "steps") {
+      if (sscanf(value, "%u %c", &steps, &rest) != 1 || steps == 0) {
+        throw error(setting.line_, "bad number of steps.");
+      }
+    } else if (key == "timeout") {
+      double timeout, s;
+      if (sscanf(value, "%lf %c", &timeout, &rest) != 1 || timeout <= 0) {
+        throw error(setting.line_, "bad timeout.");
+      }
+      setup.timeout_.tv_usec = (suseconds_t)(modf(timeout, &s) * 1000000);
+      setup.timeout_.tv_sec = (time_t)s;
+      has_timeout = true;
+    } else if (key == "duration") {
+      double duration;
+      if (sscanf(value, "%lf %c", &duration, &rest) != 1 || duration < 0) {
+        throw error(setting.line_, "bad duration.");
+      }
+      options.duration_ = to_nanoseconds(duration);
+    } else if (key == "warm-up") {
+      double warmup;
+      char unit;
+      if (sscanf(value, "%lf%c %c", &warmup, &unit, &rest) == 2 &&
+          unit == 's' && warmup > 0) {
+        options.warmup_queries_ = 0;
+        options.warmup_duration_ = to_nanoseconds(warmup);
+      } else if (sscanf(value, "%lu %c", &options.warmup_queries_, &rest) ==
+                 1) {
+        options.warmup_duration_ = std::chrono::nanoseconds{0};
+      } else {
+        throw error(setting.line_, "bad warm-up, must be a number of queries "
+                                   "or a time in seconds followed by s.");
+      }
+    } else if (key == "concurrency") {
+      if (sscanf(value, "%u %c", &options.concurrency_, &rest) != 1) {
+        throw error(setting.line_, "bad concurrency.");
+      }
+    } else if (key == "slo") {
+      double latency, loss = 0;
+      int n = sscanf(value, "%lf , %lf %c", &latency, &loss, &rest);
+      if (setting.value_ == "no") {
+        options.slo_latency_ = std::chrono::nanoseconds{0};
+      } else if ((n == 1 || n == 2) && latency > 0 && loss >= 0 &&
+                 loss <= 100) {
+        options.slo_latency_ = to_nanoseconds(latency / 1000);
+        options.slo_loss_ = loss / 100;
+      } else {
+        throw error(setting.line_, "bad objective, must be the 99th "
+                                   "percentile in ms and optionally the "
+                                   "timed out queries in percent.");
+      }
+    } else if (key == "pace") {
+      options.pace_ = parse_bool(setting.value_, setting.line_);
+    } else if (key == "perf-counters") {
+      options.perf_counters_ = parse_bool(setting.value_, setting.line_);
+    } else if (key == "txtime") {
+      if (setting.value_ == "no") {
+        options.txtime_clock_ = -1;
+      } else if (setting.value_ == "tai") {
+        options.txtime_clock_ = CLOCK_TAI;
+      } else if (setting.value_ == "monotonic") {
+        options.txtime_clock_ = CLOCK_MONOTONIC;
+      } else {
+        throw error(setting.line_, "bad txtime clock, must be tai, monotonic "
+                                   "or no.");
+      }
+    } else if (key == "transport") {
+      if (setting.value_ == "udp") {
+        options.transport_ = TransportType::UDP;
+      } else if (setting.value_ == "tcp") {
+        options.transport_ = TransportType::TCP;
+      } else if (setting.value_ == "dot") {
+        options.transport_ = TransportType::DoT;
+      } else if (setting.value_ == "doh") {
+        options.transport_ = TransportType::DoH;
+      } else {
+        throw error(setting.line_, "bad transport, must be udp, tcp, dot or "
+                                   "doh.");
+      }
+    } else if (key == "tls-sessions") {
+      if (sscanf(value, "%u %c", &options.tls_sessions_, &rest) != 1 ||
+          options.tls_sessions_ == 0) {
+        throw error(setting.line_, "bad number of TLS sessions.");
+      }
+    } else if (key == "tls-resumption") {
+      options.tls_resumption_ = parse_bool(setting.value_, setting.line_);
+    } else if (key == "h2-streams") {
+      if (sscanf(value, "%u %c", &options.h2_streams_, &rest) != 1 ||
+          options.h2_streams_ == 0) {
+        throw error(setting.line_, "bad number of HTTP/2 streams.");
+      }
+    } else if (key == "doh-path") {
+      options.doh_path_ = setting.value_;
+    } else if (key == "tcp-fastopen") {
+      options.tcp_fastopen_ = parse_bool(setting.value_, setting.line_);
+    } else if (key == "tc-retry") {
+      options.tc_retry_ = parse_bool(setting.value_, setting.line_);
+    } else if (key == "retries") {
+      if (sscanf(value, "%u %c", &options.retries_, &rest) != 1 ||
+          options.retries_ > UINT8_MAX) {
+        throw error(setting.line_, "bad number of retries, must be between 0 "
+                                   "and 255.");
+      }
+    } else if (key == "retry-interval") {
+      double retry_interval;
+      if (sscanf(value, "%lf %c", &retry_interval, &rest) != 1 ||
+          retry_interval <= 0) {
+        throw error(setting.line_, "bad retry interval.");
+      }
+      options.retry_interval_ = to_nanoseconds(retry_interval);
+    } else if (key == "retry-backoff") {
+      if (sscanf(value, "%lf %c", &options.retry_backoff_, &rest) != 1 ||
+          options.retry_backoff_ < 1) {
+        throw error(setting.line_, "bad retry backoff, must be at least 1.");
+      }
+    } else if (key == "epoch") {
+      if (setting.value_ == "no") {
+        options.epoch_label_ = false;
+      } else if (sscanf(value, "%lu %c", &options.first_epoch_, &rest) == 1) {
+        options.epoch_label_ = true;
+      } else {
+        throw error(setting.line_, "bad epoch.");
+      }
+    } else {
+      throw error(setting.line_, "unknown parameter " + key + ".");
+    }
+  }
+  if (!has_server || !has_subnet || !has_timeout) {
+    throw error(line, "phase " + name + " needs a server, a subnet and a "
+                                        "timeout.");
+  }
+  if (!has_delay && rate_from == 0 && options.concurrency_ == 0) {
+    throw error(line, "phase " + name + " needs a rate, a delay or a "
+                                        "concurrency.");
+  }
+  if (!has_requests && options.duration_.count() == 0) {
+    throw error(line, "phase " + name + " needs a number of requests or a "
+                                        "duration.");
+  }
+  if (options.tc_retry_ && options.transport_ != TransportType::UDP) {
+    throw error(line, "phase " + name + ": retrying truncated answers "
+                                        "requires the udp transport.");
+  }
+  if (options.retries_ > 0 && options.transport_ != TransportType::UDP) {
+    throw error(line, "phase " + name + ": retransmissions require the udp "
+                                        "transport.");
+  }
+  if (options.slo_latency_.count() > 0 && options.concurrency_ > 0) {
+    throw error(line, "phase " + name + ": the rate controller requires "
+                                        "sending bursts on a timer.");
+  }
+  if (options.txtime_clock_ >= 0 &&
+      (options.transport_ != TransportType::UDP || options.concurrency_ > 0)) {
+    throw error(line, "phase " + name + ": launch times require the udp "
+                                        "transport and sending bursts on a "
+                                        "timer.");
+  }
+  if (options.duration_.count() > 0 && setup.num_req_ == 0) {
+    /* No limit but the available names */
+    setup.num_req_ = options.epoch_label_
+                         ? UINT64_MAX
+                         : (uint64_t)1 << (32 - setup.netmask_);
+  }
+  if (!options.epoch_label_ &&
+      setup.num_req_ > ((uint64_t)1 << (32 - setup.netmask_))) {
+    throw error(line, "phase " + name + ": the number of requests is higher "
+                                        "than the avaliable IPs in the "
+                                        "subnet, set an epoch for more "
+                                        "names.");
+  }
+  /* A ramp is run as steps of constant rate, sharing the requests or the
+   * duration of the phase */
+  uint64_t num_req = setup.num_req_;
+  std::chrono::nanoseconds duration = options.duration_;
+  for (unsigned step = 0; step < steps; step++) {
+    Phase phase{name, setup};
+    if (steps > 1) {
+      phase.name_ += "-" + std::to_string(step + 1);
+      /* The steps run back-to-back, only the first one warms up */
+      if (step > 0) {
+        phase.setup_.options_.warmup_queries_ = 0;
+        phase.setup_.options_.warmup_duration_ = std::chrono::nanoseconds{0};
+      }
+      if (duration.count() > 0) {
+        phase.setup_.options_.duration_ = duration / steps;
+      } else {
+        phase.setup_.num_req_ = num_req / steps + (step < num_req % steps);
+      }
+    }
+    if (rate_from > 0) {
+      double rate =
+          steps > 1 ? rate_from + (rate_to - rate_from) * step / (steps - 1)
+                    : rate_from;
+      /* Every thread sends a burst at every tick */
+      phase.setup_.burst_delay_ = (uint64_t)std::llround(
+          (double)setup.num_thread_ * setup.num_burst_ * 1000000000 / rate);
+    }
+    for (const auto &other : phases_) {
+      if (other.name_ == phase.name_) {
+        throw error(line, "phase " + phase.name_ + " is not unique.");
+      }
+    }
+    phases_.push_back(phase);
+  }
+}
+
+Scenario::Scenario(const char *filename, const TestSetup &base) {
+  std::ifstream file{filename};
+  if (!file) {
+    throw ScenarioException{std::string{"Cannot open scenario "} + filename};
+  }
+  std::vector<Setting> defaults, settings;
+  std::string name, text;
+  unsigned line = 0, header = 0;
+  while (std::getline(file, text)) {
+    line++;
+    text = trim(text);
+    if (text.empty() || text[0] == '#' || text[0] == ';') {
+      continue;
+    }
+    if (text[0] == '[') {
+      if (text.back() != ']') {
+        throw error(line, "bad phase header.");
+      }
+      if (!name.empty()) {
+        add(name, header, settings, base);
+      }
+      name = trim(text.substr(1, text.size() - 2));
+      if (name.empty() ||
+          name.find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._-") !=
+              std::string::npos) {
+        throw error(line, "bad phase name, must consist of letters, digits, "
+                          "'.', '_' and '-'.");
+      }
+      header = line;
+      settings = defaults;
+      continue;
+    }
+    size_t equals = text.find('=');
+    if (equals == std::string::npos) {
+      throw error(line, "expected key = value.");
+    }
+    Setting setting{trim(text.substr(0, equals)), trim(text.substr(equals + 1)),
+                    line};
+    (name.empty() ? defaults : settings).push_back(setting);
+  }
+  if (name.empty()) {
+    throw ScenarioException{std::string{"No phase in scenario "} + filename};
+  }
+  add(name, header, settings, base);
+}
+
+const std::vector<Phase> &Scenario::phases() const { return phases_; }
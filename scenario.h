@@ -0,0 +1,109 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the scenarios of several test phases
+ */
+
+#ifndef SCENARIO_H_INCLUDED_
+#define SCENARIO_H_INCLUDED_
+
+#include "control.h"
+#include <exception>
+#include <string>
+#include <vector>
+
+/**
+ * An std::exception class for the Scenario.
+ */
+class ScenarioException : public std::exception {
+private:
+  std::string what_; /**< Exception string */
+public:
+  /**
+   * A constructor.
+   * @param what the exception string
+   */
+  ScenarioException(std::string what);
+
+  /**
+   * A getter for the exception string.
+   * @return the exception string
+   */
+  const char *what() const noexcept override;
+};
+
+/**
+ * Class to represent one phase of a scenario
+ */
+struct Phase {
+  std::string name_; /**< Name of the phase, empty for a single test */
+  TestSetup setup_;  /**< Parameters of the test of the phase */
+};
+
+/**
+ * Class to read a scenario file, a sequence of test phases run one after the
+ * other.
+ * The file consists of "key = value" lines, the lines before the first
+ * "[name]" header are the defaults of every phase, the lines after a header
+ * are the parameters of that phase. A phase with "rate = FROM-TO" and
+ * "steps = N" is a ramp, run as N phases of constant rate.
+ */
+class Scenario {
+private:
+  /**
+   * Class to represent one "key = value" line
+   */
+  struct Setting {
+    std::string key_;   /**< Name of the parameter */
+    std::string value_; /**< Value of the parameter */
+    unsigned line_;     /**< Line number in the file */
+  };
+
+  std::vector<Phase> phases_; /**< Phases of the scenario */
+
+  /**
+   * Parses the settings of a phase and appends the phase, or its steps.
+   * @param name name of the phase
+   * @param line line number of the header of the phase
+   * @param settings the defaults followed by the settings of the phase
+   * @param base parameters given on the command line
+   */
+  void add(const std::string &name, unsigned line,
+           const std::vector<Setting> &settings, const TestSetup &base);
+
+public:
+  /**
+   * Constructor, reads the file.
+   * @param filename the scenario file
+   * @param base parameters given on the command line, the defaults of the
+   * parameters not given in the file
+   */
+  Scenario(const char *filename, const TestSetup &base);
+
+  /**
+   * Getter for the phases.
+   * @return the phases in the order of the file
+   */
+  const std::vector<Phase> &phases() const;
+};
+
+#endif
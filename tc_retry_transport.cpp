@@ -0,0 +1,129 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "tc_retry_transport.h"
+#include "dns.h"
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <vector>
+
+TcRetryTransport::TcRetryTransport(const struct sockaddr_in &server,
+                                   struct timeval timeout,
+                                   std::chrono::nanoseconds query_timeout,
+                                   int txtime_clock)
+    : Transport{server, timeout}, udp_{server, timeout, txtime_clock},
+      tcp_{server, timeout, false, query_timeout}, drain_{false} {}
+
+void TcRetryTransport::send(const uint8_t *data, size_t len) {
+  udp_.send(data, len);
+}
+
+void TcRetryTransport::send_at(
+    const uint8_t *data, size_t len,
+    std::chrono::high_resolution_clock::time_point launch) {
+  udp_.send_at(data, len, launch);
+}
+
+void TcRetryTransport::retry(const uint8_t *answer, size_t len) {
+  /* Find the end of the question */
+  size_t pos = sizeof(DNSHeader);
+  while (pos < len && answer[pos] != 0) {
+    if ((answer[pos] & 0xc0) != 0) {
+      /* The question is never compressed, this is not our answer */
+      return;
+    }
+    pos += answer[pos] + 1;
+  }
+  pos += 1 + 2 * sizeof(uint16_t);
+  if (pos > len) {
+    return;
+  }
+  /* Turn the header back into the one of the query */
+  std::vector<uint8_t> query{answer, answer + pos};
+  DNSHeader *header = reinterpret_cast<DNSHeader *>(query.data());
+  header->qr(0);
+  header->aa(false);
+  header->tc(false);
+  header->ra(false);
+  header->rcode(DNSHeader::RCODE::NoError);
+  header->qdcount(1);
+  header->ancount(0);
+  header->nscount(0);
+  header->arcount(0);
+  tcp_.send(query.data(), query.size());
+}
+
+ssize_t TcRetryTransport::receive(uint8_t *buffer, size_t maxlen) {
+  struct pollfd fds[2];
+  fds[0].fd = udp_.fd();
+  fds[0].events = POLLIN;
+  fds[1].fd = tcp_.fd();
+  fds[1].events = POLLIN;
+  int timeout_ms =
+      std::max(1, (int)(timeout_.tv_sec * 1000 + timeout_.tv_usec / 1000));
+  for (;;) {
+    /* Return the answers of the retried queries first */
+    if (drain_) {
+      ssize_t recvlen = tcp_.receive(buffer, maxlen, 0);
+      if (recvlen > 0) {
+        return recvlen;
+      }
+      drain_ = false;
+    }
+    int n = ::poll(fds, 2, timeout_ms);
+    if (n == 0) {
+      errno = EWOULDBLOCK;
+      return -1;
+    } else if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (fds[0].revents & POLLERR) {
+      /* Queries dropped by the qdisc */
+      udp_.receive_errors();
+    }
+    if (fds[1].revents & POLLIN) {
+      drain_ = true;
+    }
+    if (fds[0].revents & POLLIN) {
+      ssize_t recvlen = udp_.receive(buffer, maxlen);
+      if (recvlen < (ssize_t)sizeof(DNSHeader) ||
+          !reinterpret_cast<const DNSHeader *>(buffer)->tc()) {
+        return recvlen;
+      }
+      retry(buffer, recvlen);
+    }
+  }
+}
+
+TransportStats TcRetryTransport::stats() const {
+  TransportStats stats = udp_.stats();
+  stats += tcp_.stats();
+  return stats;
+}
+
+void TcRetryTransport::reset_stats() {
+  udp_.reset_stats();
+  tcp_.reset_stats();
+}
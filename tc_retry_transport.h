@@ -0,0 +1,76 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the UDP transport retrying truncated answers over TCP
+ */
+
+#ifndef TC_RETRY_TRANSPORT_H_INCLUDED_
+#define TC_RETRY_TRANSPORT_H_INCLUDED_
+
+#include "tcp_transport.h"
+#include "transport.h"
+
+/**
+ * Class for sending queries over UDP like a stub resolver does: when the
+ * DUT truncates an answer, the query is repeated over TCP and only the TCP
+ * answer is handed to the tester, so the measured round-trip time is the
+ * latency seen by the client.
+ */
+class TcRetryTransport : public Transport {
+private:
+  UdpTransport udp_; /**< Transport of the original queries */
+  TcpTransport tcp_; /**< Transport of the retried queries */
+  bool drain_; /**< Flag to mark that the TCP transport may hold answers */
+
+  /**
+   * Repeats the query of a truncated answer over TCP.
+   * @param answer the truncated answer
+   * @param len length of the answer
+   */
+  void retry(const uint8_t *answer, size_t len);
+
+public:
+  /**
+   * Constructor.
+   * @param server address of the server
+   * @param timeout receive timeout
+   * @param query_timeout time after which an unanswered TCP connection is
+   * closed
+   * @param txtime_clock clock of the launch times of the UDP queries, or -1
+   */
+  TcRetryTransport(const struct sockaddr_in &server, struct timeval timeout,
+                   std::chrono::nanoseconds query_timeout,
+                   int txtime_clock = -1);
+
+  void send(const uint8_t *data, size_t len) override;
+
+  void send_at(const uint8_t *data, size_t len,
+               std::chrono::high_resolution_clock::time_point launch) override;
+
+  ssize_t receive(uint8_t *buffer, size_t maxlen) override;
+
+  TransportStats stats() const override;
+
+  void reset_stats() override;
+};
+
+#endif
@@ -0,0 +1,269 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "tcp_transport.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+static const size_t TCP_MAX_EVENTS = 256;
+
+TcpTransport::Connection::Connection() : established_{false}, wpos_{0} {}
+
+TcpTransport::TcpTransport(const struct sockaddr_in &server,
+                           struct timeval timeout, bool fastopen,
+                           std::chrono::nanoseconds query_timeout)
+    : Transport{server, timeout}, fastopen_{fastopen},
+      query_timeout_{query_timeout} {
+  /* Create epoll instance */
+  int epollfd;
+  if ((epollfd = ::epoll_create1(0)) == -1) {
+    std::stringstream ss;
+    ss << "Cannot create epoll instance: " << strerror(errno);
+    throw TransportException{ss.str()};
+  }
+  epoll_ = Socket{epollfd};
+}
+
+void TcpTransport::send(const uint8_t *data, size_t len) {
+  std::unique_ptr<Connection> connection{new Connection{}};
+  connection->time_started_ = std::chrono::high_resolution_clock::now();
+  /* Create socket */
+  int sockfd;
+  if ((sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK,
+                         IPPROTO_TCP)) == -1) {
+    send_errors_++;
+    std::cerr << "Can't create socket: " << strerror(errno) << std::endl;
+    return;
+  }
+  connection->sock_ = Socket{sockfd};
+  int one = 1;
+  ::setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY,
+               reinterpret_cast<const void *>(&one), sizeof(one));
+  connection->wbuf_.resize(2 + len);
+  connection->wbuf_[0] = (len >> 8) & 0xff;
+  connection->wbuf_[1] = len & 0xff;
+  memcpy(connection->wbuf_.data() + 2, data, len);
+  /* Open the connection, with Fast Open the query goes in the SYN */
+  if (fastopen_) {
+    ssize_t sent = ::sendto(
+        sockfd, connection->wbuf_.data(), connection->wbuf_.size(),
+        MSG_FASTOPEN | MSG_NOSIGNAL,
+        reinterpret_cast<const struct sockaddr *>(&server_), sizeof(server_));
+    if (sent >= 0) {
+      connection->wpos_ = sent;
+    } else if (errno != EINPROGRESS) {
+      send_errors_++;
+      std::cerr << "Can't send packet: " << strerror(errno) << std::endl;
+      return;
+    }
+  } else if (::connect(sockfd,
+                       reinterpret_cast<const struct sockaddr *>(&server_),
+                       sizeof(server_)) == -1 &&
+             errno != EINPROGRESS) {
+    send_errors_++;
+    std::cerr << "Can't send packet: " << strerror(errno) << std::endl;
+    return;
+  }
+  /* Hand the connection over to the receiver */
+  std::lock_guard<std::mutex> lock{m_};
+  struct epoll_event event;
+  memset(&event, 0x00, sizeof(event));
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.fd = sockfd;
+  if (::epoll_ctl(epoll_, EPOLL_CTL_ADD, sockfd, &event) == -1) {
+    send_errors_++;
+    std::cerr << "Can't add connection to epoll: " << strerror(errno)
+              << std::endl;
+    return;
+  }
+  opened_.emplace_back(sockfd, connection->time_started_);
+  connections_[sockfd] = std::move(connection);
+}
+
+void TcpTransport::expire() {
+  auto deadline = std::chrono::high_resolution_clock::now() - query_timeout_;
+  std::lock_guard<std::mutex> lock{m_};
+  while (!opened_.empty() && opened_.front().second < deadline) {
+    /* The socket may have been closed and reused by a newer connection */
+    auto it = connections_.find(opened_.front().first);
+    if (it != connections_.end() &&
+        it->second->time_started_ == opened_.front().second) {
+      connections_.erase(it);
+      stats_.tcp_timeouts_++;
+    }
+    opened_.pop_front();
+  }
+}
+
+void TcpTransport::close(int fd) {
+  std::lock_guard<std::mutex> lock{m_};
+  connections_.erase(fd);
+}
+
+bool TcpTransport::writable(Connection &connection) {
+  if (!connection.established_) {
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    if (::getsockopt(connection.sock_, SOL_SOCKET, SO_ERROR,
+                     reinterpret_cast<void *>(&err), &err_len) == -1 ||
+        err != 0) {
+      stats_.tcp_failures_++;
+      return false;
+    }
+    connection.established_ = true;
+    connection.time_established_ = std::chrono::high_resolution_clock::now();
+    stats_.tcp_connections_++;
+    stats_.connect_time_.add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            connection.time_established_ - connection.time_started_)
+            .count());
+    stats_.first_connect_ =
+        std::min(stats_.first_connect_, connection.time_started_);
+    stats_.last_connect_ =
+        std::max(stats_.last_connect_, connection.time_established_);
+    if (fastopen_) {
+      struct tcp_info info;
+      socklen_t info_len = sizeof(info);
+      if (::getsockopt(connection.sock_, IPPROTO_TCP, TCP_INFO,
+                       reinterpret_cast<void *>(&info), &info_len) == 0 &&
+          (info.tcpi_options & TCPI_OPT_SYN_DATA)) {
+        stats_.fastopen_connections_++;
+      }
+    }
+  }
+  while (connection.wpos_ < connection.wbuf_.size()) {
+    ssize_t sent = ::send(connection.sock_,
+                          connection.wbuf_.data() + connection.wpos_,
+                          connection.wbuf_.size() - connection.wpos_,
+                          MSG_NOSIGNAL);
+    if (sent > 0) {
+      connection.wpos_ += sent;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    } else {
+      stats_.tcp_failures_++;
+      return false;
+    }
+  }
+  /* The query is out, only wait for the answer */
+  struct epoll_event event;
+  memset(&event, 0x00, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = connection.sock_;
+  ::epoll_ctl(epoll_, EPOLL_CTL_MOD, connection.sock_, &event);
+  return true;
+}
+
+bool TcpTransport::readable(Connection &connection) {
+  uint8_t buf[4096];
+  for (;;) {
+    ssize_t recvlen = ::recv(connection.sock_, buf, sizeof(buf), 0);
+    if (recvlen > 0) {
+      connection.rbuf_.insert(connection.rbuf_.end(), buf, buf + recvlen);
+      if (connection.rbuf_.size() < 2) {
+        continue;
+      }
+      size_t msglen = (connection.rbuf_[0] << 8) | connection.rbuf_[1];
+      if (connection.rbuf_.size() < 2 + msglen) {
+        continue;
+      }
+      /* The answer is complete, the connection is done */
+      auto now = std::chrono::high_resolution_clock::now();
+      stats_.response_time_.add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              now - connection.time_established_)
+              .count());
+      stats_.exchange_time_.add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              now - connection.time_started_)
+              .count());
+      ready_.emplace_back(connection.rbuf_.begin() + 2,
+                          connection.rbuf_.begin() + 2 + msglen);
+      return false;
+    } else if (recvlen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return true;
+    }
+    /* Closed or broken before the answer arrived */
+    stats_.tcp_failures_++;
+    return false;
+  }
+}
+
+ssize_t TcpTransport::receive(uint8_t *buffer, size_t maxlen) {
+  return receive(
+      buffer, maxlen,
+      std::max(1, (int)(timeout_.tv_sec * 1000 + timeout_.tv_usec / 1000)));
+}
+
+ssize_t TcpTransport::receive(uint8_t *buffer, size_t maxlen, int timeout_ms) {
+  struct epoll_event events[TCP_MAX_EVENTS];
+  expire();
+  for (;;) {
+    /* Return the already received messages first */
+    if (!ready_.empty()) {
+      size_t len = std::min(ready_.front().size(), maxlen);
+      memcpy(buffer, ready_.front().data(), len);
+      ready_.pop_front();
+      return len;
+    }
+    int n = ::epoll_wait(epoll_, events, TCP_MAX_EVENTS, timeout_ms);
+    if (n == 0) {
+      errno = EWOULDBLOCK;
+      return -1;
+    } else if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    for (int i = 0; i < n; i++) {
+      Connection *connection;
+      {
+        std::lock_guard<std::mutex> lock{m_};
+        auto it = connections_.find(events[i].data.fd);
+        if (it == connections_.end()) {
+          continue;
+        }
+        connection = it->second.get();
+      }
+      bool open = true;
+      if ((events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) &&
+          (!connection->established_ ||
+           connection->wpos_ < connection->wbuf_.size())) {
+        open = writable(*connection);
+      }
+      if (open && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        open = readable(*connection);
+      }
+      if (!open) {
+        close(events[i].data.fd);
+      }
+    }
+  }
+}
+
+int TcpTransport::fd() { return epoll_; }
@@ -0,0 +1,134 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the connection-per-query TCP transport
+ */
+
+#ifndef TCP_TRANSPORT_H_INCLUDED_
+#define TCP_TRANSPORT_H_INCLUDED_
+
+#include "transport.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Class for sending every query over its own, short-lived TCP connection.
+ * The sender thread only opens the connection and hands the query to the
+ * kernel, the receiver thread completes the connection setup, reads the
+ * answer and closes the connection. With TCP Fast Open the query is carried
+ * in the SYN once the DUT has issued a cookie. The connection of a query
+ * that is not answered until its timeout is closed by the receiver, so an
+ * overloaded DUT does not exhaust the file descriptors of the tester.
+ */
+class TcpTransport : public Transport {
+private:
+  /**
+   * Class to represent one connection.
+   */
+  struct Connection {
+    Socket sock_;               /**< TCP socket of the connection */
+    bool established_;          /**< Flag to mark a completed setup */
+    std::chrono::high_resolution_clock::time_point
+        time_started_;          /**< Timestamp of the connection attempt */
+    std::chrono::high_resolution_clock::time_point
+        time_established_;      /**< Timestamp of the completed setup */
+    std::vector<uint8_t> wbuf_; /**< Length-prefixed query */
+    size_t wpos_;               /**< Amount of the query already written */
+    std::vector<uint8_t> rbuf_; /**< Buffer of the answer */
+
+    Connection();
+  };
+
+  bool fastopen_; /**< Flag to enable TCP Fast Open */
+  std::chrono::nanoseconds
+      query_timeout_; /**< Time after which a connection is closed */
+  Socket epoll_;      /**< Epoll instance of the connections */
+  std::mutex m_;      /**< Mutex for accessing connections_ and opened_ */
+  std::unordered_map<int, std::unique_ptr<Connection>>
+      connections_; /**< Open connections by socket */
+  std::deque<std::pair<int, std::chrono::high_resolution_clock::time_point>>
+      opened_; /**< Sockets and start times of the connections in the order
+                  of opening, to close them at the timeout */
+  std::deque<std::vector<uint8_t>> ready_; /**< Received DNS messages */
+
+  /**
+   * Closes a connection.
+   * @param fd the socket of the connection
+   */
+  void close(int fd);
+
+  /**
+   * Handles the completion of the connection setup and writes the query.
+   * @param connection the connection
+   * @return false if the connection failed
+   */
+  bool writable(Connection &connection);
+
+  /**
+   * Reads the answer from a connection.
+   * @param connection the connection
+   * @return false if the connection is finished or failed
+   */
+  bool readable(Connection &connection);
+
+  /**
+   * Closes the connections opened longer than the query timeout ago.
+   */
+  void expire();
+
+public:
+  /**
+   * Constructor.
+   * @param server address of the server
+   * @param timeout receive timeout
+   * @param fastopen whether to use TCP Fast Open
+   * @param query_timeout time after which an unanswered connection is closed
+   */
+  TcpTransport(const struct sockaddr_in &server, struct timeval timeout,
+               bool fastopen, std::chrono::nanoseconds query_timeout);
+
+  void send(const uint8_t *data, size_t len) override;
+
+  ssize_t receive(uint8_t *buffer, size_t maxlen) override;
+
+  /**
+   * Receives one DNS message, waiting at most for the given time.
+   * @param buffer the buffer to receive into
+   * @param maxlen the length of the buffer
+   * @param timeout_ms the time to wait in milliseconds
+   * @return the length of the message, or -1 with errno set to EWOULDBLOCK
+   * on timeout
+   */
+  ssize_t receive(uint8_t *buffer, size_t maxlen, int timeout_ms);
+
+  /**
+   * Getter for the epoll instance, to wait for answers with poll.
+   * @return the epoll instance
+   */
+  int fd();
+};
+
+#endif
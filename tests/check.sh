@@ -0,0 +1,63 @@
+#!/bin/bash
+# dns64perf++ - C++14 DNS64 performance tester
+# Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+# (http://ipv6.tilb.sze.hu/dns64perf/)
+# Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+# Runs short tests against the stand-in responder on the loopback interface.
+# Every test must exit successfully and report valid answers.
+# Usage: tests/check.sh [binary], from the top of the source tree
+
+BINARY=$(realpath "${1:-./dns64perf++}")
+DIR=$(dirname "$0")
+WORK=$(mktemp -d)
+UDP_PORT=${UDP_PORT:-15353}
+TCP_PORT=${TCP_PORT:-15354}
+DOT_PORT=${DOT_PORT:-15853}
+FAILED=0
+
+trap 'kill $(jobs -p) 2>/dev/null; rm -rf "$WORK"' EXIT
+
+python3 "$DIR/responder.py" udp $UDP_PORT &
+python3 "$DIR/responder.py" tcp $TCP_PORT &
+python3 "$DIR/responder.py" dot $DOT_PORT &
+sleep 2
+
+# check NAME ARGUMENTS...: runs the tester in its own directory for its CSV
+check() {
+  local name=$1
+  shift
+  mkdir -p "$WORK/$name"
+  (cd "$WORK/$name" && "$BINARY" "$@") >"$WORK/$name.log" 2>&1
+  local status=$?
+  if [ $status -ne 0 ] || ! grep -q '^Valid answers: [1-9]' "$WORK/$name.log"; then
+    echo "FAIL $name (exit status $status)"
+    cat "$WORK/$name.log"
+    FAILED=1
+  else
+    echo "ok   $name"
+  fi
+}
+
+check udp 127.0.0.1 $UDP_PORT 10.0.0.0/24 200 10 2 1000000 0.5
+check tcp -t tcp 127.0.0.1 $TCP_PORT 10.0.0.0/24 200 10 2 1000000 0.5
+check duration --duration 0.2 127.0.0.1 $UDP_PORT 10.0.0.0/16 0 10 1 0 0.5
+check closed-loop --concurrency 8 --duration 0.3 127.0.0.1 $UDP_PORT 10.0.0.0/16 0 1 2 0 0.5
+check closed-loop-warm-up --concurrency 8 --duration 0.3 --warm-up 0.1s 127.0.0.1 $UDP_PORT 10.0.0.0/16 0 1 2 0 0.5
+check dot -t dot -s 4 127.0.0.1 $DOT_PORT 10.0.0.0/24 200 10 2 1000000 0.5
+
+exit $FAILED
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+# dns64perf++ - C++14 DNS64 performance tester
+# Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+# (http://ipv6.tilb.sze.hu/dns64perf/)
+# Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+"""Stand-in DNS64 server for testing dns64perf++ without a DUT.
+
+Answers every AAAA query with a synthesized 64:ff9b::/96 address over UDP,
+over TCP, or over TLS (DNS over TLS). Without a certificate, a self-signed
+one is generated with the openssl command for the TLS mode. It is not meant
+to be fast, only to exercise the transports of the tester.
+
+Usage: responder.py [--cert FILE --key FILE] udp|tcp|dot PORT
+"""
+
+import argparse
+import os
+import socket
+import ssl
+import struct
+import subprocess
+import tempfile
+import threading
+
+
+def answer(query):
+    """Builds the answer of a query: the question and one AAAA record."""
+    header = bytearray(query[:12])
+    flags = struct.unpack(">H", header[2:4])[0] | 0x8080  # QR and RA
+    header[2:4] = struct.pack(">H", flags)
+    header[6:8] = struct.pack(">H", 1)  # ANCOUNT
+    record = b"\xc0\x0c" + struct.pack(">HHIH", 28, 1, 60, 16)
+    address = b"\x00\x64\xff\x9b" + b"\x00" * 12
+    return bytes(header) + bytes(query[12:]) + record + address
+
+
+def serve_udp(port):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", port))
+    while True:
+        query, address = sock.recvfrom(4096)
+        if len(query) >= 12:
+            sock.sendto(answer(query), address)
+
+
+def serve_stream(conn):
+    """Answers the length-prefixed queries of one connection (RFC 7766)."""
+    buffer = b""
+    try:
+        while True:
+            data = conn.recv(65536)
+            if not data:
+                break
+            buffer += data
+            out = b""
+            while len(buffer) >= 2:
+                length = struct.unpack(">H", buffer[:2])[0]
+                if len(buffer) < 2 + length:
+                    break
+                message = answer(buffer[2:2 + length])
+                out += struct.pack(">H", len(message)) + message
+                buffer = buffer[2 + length:]
+            if out:
+                conn.sendall(out)
+    except (OSError, ssl.SSLError):
+        pass
+    conn.close()
+
+
+def serve_tcp(port, context):
+    sock = socket.socket()
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if context is None and hasattr(socket, "TCP_FASTOPEN"):
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_FASTOPEN, 256)
+    sock.bind(("127.0.0.1", port))
+    sock.listen(1024)
+    while True:
+        conn, _ = sock.accept()
+
+        def run(conn=conn):
+            if context is not None:
+                try:
+                    conn = context.wrap_socket(conn, server_side=True)
+                except (OSError, ssl.SSLError):
+                    conn.close()
+                    return
+            serve_stream(conn)
+
+        threading.Thread(target=run, daemon=True).start()
+
+
+def tls_context(cert, key):
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    if cert is None:
+        directory = tempfile.mkdtemp(prefix="dns64perf-responder-")
+        cert = os.path.join(directory, "cert.pem")
+        key = os.path.join(directory, "key.pem")
+        subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048",
+                        "-nodes", "-days", "1", "-subj", "/CN=localhost",
+                        "-keyout", key, "-out", cert],
+                       check=True, stdout=subprocess.DEVNULL,
+                       stderr=subprocess.DEVNULL)
+    context.load_cert_chain(cert, key)
+    return context
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cert", help="certificate of the TLS mode")
+    parser.add_argument("--key", help="private key of the certificate")
+    parser.add_argument("mode", choices=["udp", "tcp", "dot"])
+    parser.add_argument("port", type=int)
+    args = parser.parse_args()
+    if args.mode == "udp":
+        serve_udp(args.port)
+    elif args.mode == "tcp":
+        serve_tcp(args.port, None)
+    else:
+        serve_tcp(args.port, tls_context(args.cert, args.key))
+
+
+if __name__ == "__main__":
+    main()
@@ -26,20 +26,23 @@
 
 Timer::Timer(const std::string &threadName, std::function<void(void)> &&prepare,
              std::function<void(void)> &&task,
-             std::chrono::nanoseconds interval, size_t n)
+             std::chrono::nanoseconds interval, size_t n, SleepStrategy sleep,
+             bool report)
     : thread_name_{threadName}, prepare_{prepare}, task_{task},
-      interval_{interval}, n_{n}, stop_{false} {}
+      interval_{interval}, n_{n}, stop_{false}, rescheduled_{false},
+      next_interval_{0}, next_n_{0}, sleep_{sleep}, report_{report} {}
 
 void Timer::run() {
   std::chrono::high_resolution_clock::time_point before, starttime;
   std::chrono::nanoseconds interval, function_execution_time, sleep_time,
-      full_time;
+      full_time, specified_time{0};
   size_t n;
 
   prepare_();
 
   n = n_;
   starttime = std::chrono::high_resolution_clock::now();
+  auto first_start = starttime;
   while (!stop_ && n > 0) {
     before = std::chrono::high_resolution_clock::now();
     interval =
@@ -50,6 +53,7 @@ void Timer::run() {
     } else {
       interval /= n;
     }
+    scheduled_ = starttime + (n_ - n) * interval_;
     task_();
     function_execution_time =
         std::chrono::duration_cast<std::chrono::nanoseconds>(
@@ -60,12 +64,34 @@ void Timer::run() {
     }
 #endif
     --n;
+    if (rescheduled_) {
+      /* Count the next executions from the scheduled time of this one */
+      starttime += (n_ - n - 1) * interval_;
+      specified_time += (n_ - n - 1) * interval_;
+      interval_ = next_interval_;
+      n = next_n_;
+      n_ = n + 1;
+      rescheduled_ = false;
+    }
      sleep_time = starttime + (n_-n)*interval_ - std::chrono::high_resolution_clock::now();
     if (sleep_time.count() > 0) {
 #ifdef DEBUG
       before = std::chrono::high_resolution_clock::now();
 #endif
-      spinsleep::sleep_for(sleep_time);
+      switch (sleep_) {
+      case SleepStrategy::Spin:
+        spinsleep::sleep_for(sleep_time);
+        break;
+      case SleepStrategy::System:
+        std::this_thread::sleep_for(sleep_time);
+        break;
+      case SleepStrategy::Hybrid:
+        if (sleep_time > TIMER_SPIN) {
+          std::this_thread::sleep_for(sleep_time - TIMER_SPIN);
+        }
+        spinsleep::sleep_until(starttime + (n_ - n) * interval_);
+        break;
+      }
 #ifdef DEBUG
       std::chrono::nanoseconds real_sleep_time =
           std::chrono::duration_cast<std::chrono::nanoseconds>(
@@ -79,10 +105,14 @@ void Timer::run() {
     }
   }
   full_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
-      std::chrono::high_resolution_clock::now() - starttime);
+      std::chrono::high_resolution_clock::now() - first_start);
+  specified_time += n_ * interval_;
+  if (!report_) {
+    return;
+  }
   fprintf(stderr, "Full timer execution took %lu ns, %.02f%% of specified.\n",
           full_time.count(),
-          ((double)full_time.count() / (n_ * interval_.count())) * 100);
+          ((double)full_time.count() / specified_time.count()) * 100);
 }
 
 Timer::~Timer() {
@@ -96,6 +126,16 @@ void Timer::start() {
   pthread_setname_np(thread_.native_handle(), thread_name_.c_str());
 }
 
+void Timer::reschedule(std::chrono::nanoseconds interval, size_t n) {
+  rescheduled_ = true;
+  next_interval_ = interval;
+  next_n_ = n;
+}
+
+std::chrono::high_resolution_clock::time_point Timer::scheduled() const {
+  return scheduled_;
+}
+
 void Timer::stop() {
   if (!stop_) {
     stop_ = true;
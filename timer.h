@@ -29,12 +29,26 @@
 #include <atomic>
 #include <chrono>
 #include <functional>
+#include <string>
 #include <thread>
 
+static const std::chrono::microseconds TIMER_SPIN{
+    100}; /**< Time spun after a system sleep of the hybrid strategy */
+
 /**
  * Class to represent a generic, function execution time corrected timer.
  */
 class Timer {
+public:
+  /**
+   * Enum for the way of waiting for the next execution
+   */
+  enum class SleepStrategy {
+    Spin,   /**< Busy waiting, the most accurate, keeps a CPU busy */
+    System, /**< Sleeping in the kernel, woken up by a timer interrupt */
+    Hybrid  /**< Sleeping in the kernel, then spinning for TIMER_SPIN */
+  };
+
 private:
   std::string thread_name_;
   std::function<void(void)>
@@ -45,6 +59,13 @@ private:
   size_t n_;                          /**< Number of times to repeat */
   std::thread thread_;     /**< The thread on which the timer executes */
   std::atomic<bool> stop_; /**< Atomic variable to stop the timer */
+  bool rescheduled_;       /**< Flag to mark a new interval */
+  std::chrono::nanoseconds next_interval_; /**< The new interval */
+  size_t next_n_; /**< Number of times to repeat with the new interval */
+  SleepStrategy sleep_; /**< Way of waiting for the next execution */
+  bool report_; /**< Flag to print the execution time at the end */
+  std::chrono::high_resolution_clock::time_point
+      scheduled_; /**< Scheduled time of the current execution */
 
   /**
    * Function to execute on the thread
@@ -57,10 +78,13 @@ public:
    * @param task task to execute
    * @param interval timer interval in nanoseconds
    * @param n number of time to repeat
+   * @param sleep way of waiting for the next execution
+   * @param report whether to print the execution time at the end
    */
   Timer(const std::string &thread_name, std::function<void(void)> &&prepare,
         std::function<void(void)> &&task, std::chrono::nanoseconds interval,
-        size_t n);
+        size_t n, SleepStrategy sleep = SleepStrategy::Spin,
+        bool report = true);
 
   /**
    * Destructor.
@@ -76,6 +100,21 @@ public:
    * Stops timer.
    */
   void stop();
+
+  /**
+   * Changes the interval from the next execution of the task, measured from
+   * the current one. Can only be called by the task.
+   * @param interval the new timer interval in nanoseconds
+   * @param n number of times to repeat with the new interval
+   */
+  void reschedule(std::chrono::nanoseconds interval, size_t n);
+
+  /**
+   * Getter for the time the current execution of the task was scheduled
+   * for. Can only be called by the task.
+   * @return the scheduled time
+   */
+  std::chrono::high_resolution_clock::time_point scheduled() const;
 };
 
 #endif
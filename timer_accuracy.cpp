@@ -0,0 +1,133 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "timer_accuracy.h"
+#include "affinity.h"
+#include "histogram.h"
+#include "spin_sleep.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+
+TimerAccuracy::TimerAccuracy(const std::vector<int> &cpus)
+    : cpus_(cpus),
+      max_threads_{cpus.empty()
+                       ? std::max(std::thread::hardware_concurrency(), 1u)
+                       : (unsigned)cpus.size()} {}
+
+void TimerAccuracy::measure(std::chrono::nanoseconds interval,
+                            unsigned threads, Timer::SleepStrategy sleep) {
+  size_t n = std::max(TIMER_ACCURACY_TICKS,
+                      (size_t)(std::chrono::nanoseconds{TIMER_ACCURACY_TIME} /
+                               interval));
+  std::vector<Histogram> lateness(threads);
+  std::vector<uint64_t> missed(threads, 0);
+  std::vector<std::unique_ptr<Timer>> timers;
+  /* The timers start together, after every thread is created */
+  auto start = std::chrono::high_resolution_clock::now() +
+               std::chrono::milliseconds{10};
+  for (unsigned i = 0; i < threads; i++) {
+    int cpu = cpus_.empty() ? -1 : cpus_[i];
+    /* The task reads its own timer, not the vector destroyed meanwhile */
+    auto self = std::make_shared<Timer *>(nullptr);
+    timers.emplace_back(new Timer{
+        "Timer " + std::to_string(i),
+        [start, cpu]() {
+          affinity::pin(cpu);
+          spinsleep::sleep_until(start);
+        },
+        [&lateness, &missed, self, i, interval]() {
+          auto late = std::chrono::high_resolution_clock::now() -
+                      (*self)->scheduled();
+          lateness[i].add(std::max(
+              (int64_t)0,
+              (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  late)
+                  .count()));
+          if (late > interval) {
+            missed[i]++;
+          }
+        },
+        interval, n, sleep, false});
+    *self = timers.back().get();
+  }
+  for (auto &timer : timers) {
+    timer->start();
+  }
+  timers.clear();
+  Histogram total;
+  uint64_t total_missed = 0;
+  for (unsigned i = 0; i < threads; i++) {
+    total += lateness[i];
+    total_missed += missed[i];
+  }
+  char name[32];
+  if (interval < std::chrono::milliseconds{1}) {
+    snprintf(name, sizeof(name), "%lu us",
+             (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                 interval)
+                 .count());
+  } else {
+    snprintf(name, sizeof(name), "%lu ms",
+             (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                 interval)
+                 .count());
+  }
+  const char *sleep_name = "spin";
+  switch (sleep) {
+  case Timer::SleepStrategy::Spin:
+    break;
+  case Timer::SleepStrategy::System:
+    sleep_name = "system";
+    break;
+  case Timer::SleepStrategy::Hybrid:
+    sleep_name = "hybrid";
+    break;
+  }
+  printf("%8s %7u %-7s %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f%%\n", name, threads,
+         sleep_name, total.percentile(50) / 1000.0,
+         total.percentile(90) / 1000.0, total.percentile(99) / 1000.0,
+         total.percentile(99.9) / 1000.0, total.max() / 1000.0,
+         (double)total_missed / total.count() * 100);
+  fflush(stdout);
+}
+
+void TimerAccuracy::run() {
+  printf("Lateness of the timer ticks in us, on %u %s CPUs\n", max_threads_,
+         cpus_.empty() ? "unpinned" : "pinned");
+  printf("%8s %7s %-7s %9s %9s %9s %9s %9s %10s\n", "Interval", "Threads",
+         "Sleep", "p50", "p90", "p99", "p99.9", "max", "late");
+  for (std::chrono::nanoseconds interval = std::chrono::microseconds{1};
+       interval <= std::chrono::milliseconds{10}; interval *= 10) {
+    for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads_)) {
+      for (auto sleep :
+           {Timer::SleepStrategy::Spin, Timer::SleepStrategy::System,
+            Timer::SleepStrategy::Hybrid}) {
+        measure(interval, threads, sleep);
+      }
+      if (threads == max_threads_) {
+        break;
+      }
+    }
+  }
+}
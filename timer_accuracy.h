@@ -0,0 +1,73 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the characterization of the accuracy of the Timer
+ */
+
+#ifndef TIMER_ACCURACY_H_INCLUDED_
+#define TIMER_ACCURACY_H_INCLUDED_
+
+#include "timer.h"
+#include <chrono>
+#include <stddef.h>
+#include <vector>
+
+static const std::chrono::milliseconds TIMER_ACCURACY_TIME{
+    500}; /**< Time of measuring one combination */
+static const size_t TIMER_ACCURACY_TICKS =
+    100; /**< Smallest number of ticks of one combination */
+
+/**
+ * Class to characterize the accuracy of the Timer on this host.
+ * Timers with a no-op task run at intervals from 1 us to 10 ms, on 1, 2,
+ * 4, ... threads at the same time, with every sleep strategy, and the
+ * percentiles of the lateness of their ticks are printed as a table. A
+ * tick later than the interval means that the timer cannot keep up.
+ */
+class TimerAccuracy {
+private:
+  std::vector<int> cpus_; /**< CPUs of the timers, or empty */
+  unsigned max_threads_;  /**< Largest number of timers run at once */
+
+  /**
+   * Measures one combination and prints its row of the table.
+   * @param interval the interval of the timers
+   * @param threads number of timers run at once
+   * @param sleep the sleep strategy of the timers
+   */
+  void measure(std::chrono::nanoseconds interval, unsigned threads,
+               Timer::SleepStrategy sleep);
+
+public:
+  /**
+   * Constructor.
+   * @param cpus CPUs of the timers, or empty to leave them unpinned
+   */
+  TimerAccuracy(const std::vector<int> &cpus);
+
+  /**
+   * Measures every combination and prints the table.
+   */
+  void run();
+};
+
+#endif
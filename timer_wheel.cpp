@@ -0,0 +1,72 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "timer_wheel.h"
+
+static const uint64_t TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_BITS;
+static const uint64_t TIMER_WHEEL_MASK = TIMER_WHEEL_SLOTS - 1;
+
+TimerWheel::TimerWheel() : now_{0} {
+  slots_.resize(TIMER_WHEEL_SLOTS * TIMER_WHEEL_LEVELS);
+}
+
+void TimerWheel::insert(const Entry &entry) {
+  uint64_t delta = entry.tick_ - now_;
+  for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    if (delta < ((uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))) ||
+        level == TIMER_WHEEL_LEVELS - 1) {
+      slots_[level * TIMER_WHEEL_SLOTS +
+             ((entry.tick_ >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK)]
+          .push_back(entry);
+      return;
+    }
+  }
+}
+
+void TimerWheel::cascade() {
+  for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+    /* Only cascade when the level below has wrapped around */
+    if ((now_ & (((uint64_t)1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+      return;
+    }
+    std::vector<Entry> &slot =
+        slots_[level * TIMER_WHEEL_SLOTS +
+               ((now_ >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK)];
+    cascading_.swap(slot);
+    for (const auto &entry : cascading_) {
+      insert(entry);
+    }
+    cascading_.clear();
+  }
+}
+
+void TimerWheel::schedule(uint64_t index, uint64_t tick) {
+  uint64_t max_delta =
+      ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+  if (tick <= now_) {
+    tick = now_ + 1;
+  } else if (tick - now_ > max_delta) {
+    tick = now_ + max_delta;
+  }
+  insert(Entry{index, tick});
+}
+
+uint64_t TimerWheel::now() const { return now_; }
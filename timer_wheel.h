@@ -0,0 +1,112 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for a hierarchical timer wheel
+ */
+
+#ifndef TIMER_WHEEL_H_INCLUDED_
+#define TIMER_WHEEL_H_INCLUDED_
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+static const unsigned TIMER_WHEEL_BITS = 6; /**< log2 of slots per level */
+static const unsigned TIMER_WHEEL_LEVELS = 4; /**< Number of levels */
+
+/**
+ * Class to represent a hierarchical timer wheel of query indices.
+ * Time is measured in ticks. Level 0 has a slot for each of the next 64
+ * ticks, every further level has 64 times coarser slots, so delays up to
+ * 2^24 ticks are covered with 256 slots. When level 0 wraps around, the next
+ * slot of level 1 is cascaded into level 0, and so on, so every entry is
+ * moved at most once per level: scheduling is O(1), and advancing the wheel
+ * is O(1) per tick plus the work of the expired entries. Entries are never
+ * removed: the owner ignores the expiry of a query already resolved. The
+ * slots keep their capacity, so a wheel in steady state does not allocate.
+ */
+class TimerWheel {
+private:
+  /**
+   * Class to represent one timer
+   */
+  struct Entry {
+    uint64_t index_; /**< Index of the query */
+    uint64_t tick_;  /**< Tick to expire at */
+  };
+
+  std::vector<std::vector<Entry>> slots_; /**< Entries of each slot */
+  std::vector<Entry> cascading_; /**< Entries of the slot being cascaded */
+  uint64_t now_;                 /**< Current tick */
+
+  /**
+   * Puts an entry into the slot of its tick.
+   * @param entry the entry
+   */
+  void insert(const Entry &entry);
+
+  /**
+   * Moves the entries of the current slots of the upper levels down.
+   */
+  void cascade();
+
+public:
+  /**
+   * Constructor.
+   */
+  TimerWheel();
+
+  /**
+   * Schedules a query.
+   * @param index index of the query
+   * @param tick the tick to expire at, clipped into the range of the wheel
+   */
+  void schedule(uint64_t index, uint64_t tick);
+
+  /**
+   * Getter for the current tick.
+   * @return the current tick
+   */
+  uint64_t now() const;
+
+  /**
+   * Advances the wheel, expiring the queries of the elapsed ticks.
+   * @param tick the tick to advance to
+   * @param expire function called with the index of every expired query, it
+   * may schedule further queries
+   */
+  template <typename F> void advance(uint64_t tick, F expire) {
+    while (now_ < tick) {
+      now_++;
+      cascade();
+      std::vector<Entry> &slot =
+          slots_[now_ & ((1 << TIMER_WHEEL_BITS) - 1)];
+      /* expire() never schedules into the current slot */
+      for (size_t i = 0; i < slot.size(); i++) {
+        expire(slot[i].index_);
+      }
+      slot.clear();
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,211 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "tls_transport.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+TlsTransport::TlsTransport(const struct sockaddr_in &server,
+                           struct timeval timeout, bool resumption,
+                           const unsigned char *alpn, size_t alpn_len)
+    : Transport{server, timeout}, ctx_{nullptr}, resume_session_{nullptr},
+      resumption_{resumption} {
+  /* Create the TLS context */
+  if ((ctx_ = SSL_CTX_new(TLS_client_method())) == nullptr) {
+    throw TransportException{ssl_error_string("Cannot create TLS context")};
+  }
+  /* The DUT is not authenticated, we are only interested in its speed */
+  SSL_CTX_set_verify(ctx_, SSL_VERIFY_NONE, nullptr);
+  SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                             SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  if (alpn != nullptr && SSL_CTX_set_alpn_protos(ctx_, alpn, alpn_len) != 0) {
+    throw TransportException{ssl_error_string("Cannot set ALPN")};
+  }
+  SSL_CTX_set_app_data(ctx_, this);
+  SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT |
+                                           SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx_, &TlsTransport::new_session_cb);
+  /* Create epoll instance */
+  int epollfd;
+  if ((epollfd = ::epoll_create1(0)) == -1) {
+    std::stringstream ss;
+    ss << "Cannot create epoll instance: " << strerror(errno);
+    throw TransportException{ss.str()};
+  }
+  epoll_ = Socket{epollfd};
+}
+
+TlsTransport::~TlsTransport() {
+  if (resume_session_ != nullptr) {
+    SSL_SESSION_free(resume_session_);
+  }
+  if (ctx_ != nullptr) {
+    SSL_CTX_free(ctx_);
+  }
+}
+
+std::string TlsTransport::ssl_error_string(const char *what) {
+  char buf[256];
+  std::stringstream ss;
+  ss << what;
+  unsigned long err = ERR_get_error();
+  if (err != 0) {
+    ERR_error_string_n(err, buf, sizeof(buf));
+    ss << ": " << buf;
+  }
+  ERR_clear_error();
+  return ss.str();
+}
+
+int TlsTransport::timeout_ms() const {
+  return std::max(1, (int)(timeout_.tv_sec * 1000 + timeout_.tv_usec / 1000));
+}
+
+int TlsTransport::new_session_cb(SSL *ssl, SSL_SESSION *session) {
+  TlsTransport *transport = reinterpret_cast<TlsTransport *>(
+      SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  /* Keep the newest ticket, as TLS 1.3 tickets may be single-use */
+  if (!SSL_SESSION_is_resumable(session)) {
+    return 0;
+  }
+  if (transport->resume_session_ != nullptr) {
+    SSL_SESSION_free(transport->resume_session_);
+  }
+  transport->resume_session_ = session;
+  return 1;
+}
+
+SSL *TlsTransport::connect(Socket &sock) {
+  /* Create socket */
+  int sockfd;
+  if ((sockfd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+    std::stringstream ss;
+    ss << "Cannot create socket: " << strerror(errno);
+    throw TransportException{ss.str()};
+  }
+  sock = Socket{sockfd};
+  int one = 1;
+  if (::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+                   reinterpret_cast<const void *>(&one), sizeof(one))) {
+    throw TransportException("Cannot set TCP_NODELAY: setsockopt failed");
+  }
+  if (::connect(sock, reinterpret_cast<const struct sockaddr *>(&server_),
+                sizeof(server_)) == -1) {
+    std::stringstream ss;
+    ss << "Cannot connect to the DUT: " << strerror(errno);
+    throw TransportException{ss.str()};
+  }
+  /* TLS handshake */
+  SSL *ssl;
+  if ((ssl = SSL_new(ctx_)) == nullptr) {
+    throw TransportException{ssl_error_string("Cannot create TLS session")};
+  }
+  if (SSL_set_fd(ssl, sock) != 1) {
+    SSL_free(ssl);
+    throw TransportException{ssl_error_string("Cannot create TLS session")};
+  }
+  if (resumption_ && resume_session_ != nullptr) {
+    /* Consume the ticket, the resumed session will issue a new one */
+    SSL_set_session(ssl, resume_session_);
+    SSL_SESSION_free(resume_session_);
+    resume_session_ = nullptr;
+  }
+  auto before = std::chrono::high_resolution_clock::now();
+  if (SSL_connect(ssl) != 1) {
+    SSL_free(ssl);
+    throw TransportException{ssl_error_string("TLS handshake failed")};
+  }
+  auto after = std::chrono::high_resolution_clock::now();
+  auto handshake_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(after - before);
+  /* The testers are set up in parallel, so their handshakes overlap */
+  stats_.first_handshake_ = std::min(stats_.first_handshake_, before);
+  stats_.last_handshake_ = std::max(stats_.last_handshake_, after);
+  if (SSL_session_reused(ssl)) {
+    stats_.resumed_handshakes_++;
+    stats_.resumed_handshake_time_ += handshake_time;
+  } else {
+    stats_.handshakes_++;
+    stats_.handshake_time_ += handshake_time;
+  }
+  /* From now on the connection is driven by epoll */
+  int flags = ::fcntl(sock, F_GETFL, 0);
+  if (flags == -1 || ::fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1) {
+    SSL_free(ssl);
+    throw TransportException("Cannot set socket to non-blocking mode");
+  }
+  return ssl;
+}
+
+size_t TlsTransport::await_ticket(Socket &sock, SSL *ssl, uint8_t *buffer,
+                                  size_t maxlen) {
+  /* TLS 1.3 tickets are sent after the handshake, so read until one arrives */
+  size_t len = 0;
+  auto deadline =
+      std::chrono::high_resolution_clock::now() + std::chrono::seconds{1};
+  while (resume_session_ == nullptr &&
+         std::chrono::high_resolution_clock::now() < deadline &&
+         len < maxlen) {
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (::poll(&pfd, 1, 10) > 0) {
+      int ret = SSL_read(ssl, buffer + len, (int)(maxlen - len));
+      if (ret > 0) {
+        len += ret;
+      } else {
+        int err = SSL_get_error(ssl, ret);
+        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+          throw TransportException{
+              ssl_error_string("TLS session closed after handshake")};
+        }
+      }
+    }
+  }
+  if (resume_session_ == nullptr) {
+    std::cerr << "The DUT did not send a session ticket, resumption disabled."
+              << std::endl;
+    resumption_ = false;
+  }
+  return len;
+}
+
+void TlsTransport::watch(Socket &sock, uint64_t id) {
+  struct epoll_event event;
+  memset(&event, 0x00, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = id;
+  if (::epoll_ctl(epoll_, EPOLL_CTL_ADD, sock, &event) == -1) {
+    std::stringstream ss;
+    ss << "Cannot add connection to epoll: " << strerror(errno);
+    throw TransportException{ss.str()};
+  }
+}
@@ -0,0 +1,107 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the common base of the TLS based transports
+ */
+
+#ifndef TLS_TRANSPORT_H_INCLUDED_
+#define TLS_TRANSPORT_H_INCLUDED_
+
+#include "transport.h"
+#include <openssl/ssl.h>
+#include <string>
+
+/**
+ * Base class for the transports carrying the queries over TLS connections.
+ * It creates the TLS context, establishes the connections with optional
+ * session resumption, accounts the handshakes and owns the epoll instance
+ * used by the receiver to wait for the connections.
+ */
+class TlsTransport : public Transport {
+protected:
+  SSL_CTX *ctx_;                /**< OpenSSL context */
+  SSL_SESSION *resume_session_; /**< Newest session ticket to resume */
+  bool resumption_;             /**< Flag to enable session resumption */
+  Socket epoll_;                /**< Epoll instance of the connections */
+
+  /**
+   * Constructor.
+   * @param server address of the server
+   * @param timeout receive timeout
+   * @param resumption whether to resume session tickets
+   * @param alpn the ALPN protocol list in wire format, or nullptr
+   * @param alpn_len length of the ALPN protocol list
+   */
+  TlsTransport(const struct sockaddr_in &server, struct timeval timeout,
+               bool resumption, const unsigned char *alpn, size_t alpn_len);
+
+  /**
+   * Destructor.
+   */
+  ~TlsTransport();
+
+  /**
+   * Establishes a TCP connection and does the TLS handshake, resuming the
+   * stored ticket if available. The socket is non-blocking afterwards.
+   * @param sock the socket to store the connection in
+   * @return the OpenSSL connection object, owned by the caller
+   */
+  SSL *connect(Socket &sock);
+
+  /**
+   * Waits for the session ticket of a freshly handshaked connection.
+   * @param sock the socket of the connection
+   * @param ssl the OpenSSL connection object
+   * @param buffer buffer for the application data read meanwhile
+   * @param maxlen length of the buffer
+   * @return the amount of application data read
+   */
+  size_t await_ticket(Socket &sock, SSL *ssl, uint8_t *buffer, size_t maxlen);
+
+  /**
+   * Adds a connection to the epoll instance.
+   * @param sock the socket of the connection
+   * @param id identifier returned in the epoll events
+   */
+  void watch(Socket &sock, uint64_t id);
+
+  /**
+   * Builds an exception string from the OpenSSL error queue.
+   * @param what description of the failed operation
+   * @return the exception string
+   */
+  static std::string ssl_error_string(const char *what);
+
+  /**
+   * Receive timeout in milliseconds for epoll_wait.
+   * @return the timeout
+   */
+  int timeout_ms() const;
+
+private:
+  /**
+   * Callback for new session tickets.
+   */
+  static int new_session_cb(SSL *ssl, SSL_SESSION *session);
+};
+
+#endif
@@ -0,0 +1,284 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include "transport.h"
+#include "dns.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <sstream>
+#include <sys/socket.h>
+
+TransportException::TransportException(std::string what) : what_{what} {}
+
+const char *TransportException::what() const noexcept { return what_.c_str(); }
+
+TransportStats::TransportStats()
+    : handshakes_{0}, resumed_handshakes_{0}, handshake_time_{0},
+      resumed_handshake_time_{0},
+      first_handshake_{std::chrono::high_resolution_clock::time_point::max()},
+      last_handshake_{std::chrono::high_resolution_clock::time_point::min()},
+      disconnects_{0}, stream_waits_{0}, stream_wait_time_{0},
+      stream_errors_{0}, stream_timeouts_{0}, tcp_connections_{0}, tcp_failures_{0}, tcp_timeouts_{0},
+      fastopen_connections_{0},
+      first_connect_{std::chrono::high_resolution_clock::time_point::max()},
+      last_connect_{std::chrono::high_resolution_clock::time_point::min()},
+      truncated_{0}, txtime_drops_{0}, send_errors_{0} {}
+
+TransportStats &TransportStats::operator+=(const TransportStats &rhs) {
+  handshakes_ += rhs.handshakes_;
+  resumed_handshakes_ += rhs.resumed_handshakes_;
+  handshake_time_ += rhs.handshake_time_;
+  resumed_handshake_time_ += rhs.resumed_handshake_time_;
+  first_handshake_ = std::min(first_handshake_, rhs.first_handshake_);
+  last_handshake_ = std::max(last_handshake_, rhs.last_handshake_);
+  disconnects_ += rhs.disconnects_;
+  stream_waits_ += rhs.stream_waits_;
+  stream_wait_time_ += rhs.stream_wait_time_;
+  stream_errors_ += rhs.stream_errors_;
+  stream_timeouts_ += rhs.stream_timeouts_;
+  connections_.insert(connections_.end(), rhs.connections_.begin(),
+                      rhs.connections_.end());
+  tcp_connections_ += rhs.tcp_connections_;
+  tcp_failures_ += rhs.tcp_failures_;
+  tcp_timeouts_ += rhs.tcp_timeouts_;
+  fastopen_connections_ += rhs.fastopen_connections_;
+  connect_time_ += rhs.connect_time_;
+  response_time_ += rhs.response_time_;
+  exchange_time_ += rhs.exchange_time_;
+  first_connect_ = std::min(first_connect_, rhs.first_connect_);
+  last_connect_ = std::max(last_connect_, rhs.last_connect_);
+  truncated_ += rhs.truncated_;
+  txtime_drops_ += rhs.txtime_drops_;
+  send_errors_ += rhs.send_errors_;
+  return *this;
+}
+
+Transport::Transport(const struct sockaddr_in &server, struct timeval timeout)
+    : server_(server), timeout_(timeout), send_errors_{0},
+      disconnects_{0} {}
+
+Transport::~Transport() {}
+
+TransportStats Transport::stats() const {
+  TransportStats stats = stats_;
+  stats.send_errors_ = send_errors_;
+  stats.disconnects_ = disconnects_;
+  return stats;
+}
+
+void Transport::reset_stats() {
+  /* Every connection keeps its own, empty latency histogram */
+  size_t num_connections = stats_.connections_.size();
+  stats_ = TransportStats{};
+  stats_.connections_.resize(num_connections);
+  send_errors_ = 0;
+  disconnects_ = 0;
+}
+
+void Transport::send_at(const uint8_t *data, size_t len,
+                        std::chrono::high_resolution_clock::time_point) {
+  send(data, len);
+}
+
+UdpTransport::UdpTransport(const struct sockaddr_in &server,
+                           struct timeval timeout, int txtime_clock)
+    : Transport{server, timeout}, txtime_clock_{txtime_clock},
+      txtime_offset_{0}, receives_{0} {
+  /* Create socket */
+  int sockfd;
+  if ((sockfd = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+    std::stringstream ss;
+    ss << "Cannot create socket: " << strerror(errno);
+    throw TransportException{ss.str()};
+  }
+  sock_ = Socket{sockfd};
+  /* Bind socket */
+  struct sockaddr_in local_addr;
+  memset(&local_addr, 0x00, sizeof(local_addr));
+  local_addr.sin_family = AF_INET;  // IPv6
+  local_addr.sin_addr.s_addr = htonl (INADDR_ANY); // To any valid IP address
+  local_addr.sin_port = htons(0);    // Get a random port
+  if (::bind(sock_, reinterpret_cast<struct sockaddr *>(&local_addr),
+             sizeof(local_addr)) == -1) {
+    std::stringstream ss;
+    ss << "Unable to bind socket: " << strerror(errno);
+    throw TransportException{ss.str()};
+  }
+  /* Set socket timeout */
+  if (::setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO,
+                   reinterpret_cast<const void *>(&timeout_),
+                   sizeof(timeout_))) {
+    throw TransportException("Cannot set timeout: setsockopt failed");
+  }
+  if (txtime_clock_ >= 0) {
+    /* Let the qdisc report the queries it drops */
+    struct sock_txtime txtime;
+    txtime.clockid = txtime_clock_;
+    txtime.flags = SOF_TXTIME_REPORT_ERRORS;
+    if (::setsockopt(sock_, SOL_SOCKET, SO_TXTIME,
+                     reinterpret_cast<const void *>(&txtime),
+                     sizeof(txtime))) {
+      std::stringstream ss;
+      ss << "Cannot enable SO_TXTIME: " << strerror(errno);
+      throw TransportException{ss.str()};
+    }
+    /* Read the clock between two readings of the clock of the tester */
+    struct timespec ts;
+    auto before = std::chrono::high_resolution_clock::now();
+    ::clock_gettime(txtime_clock_, &ts);
+    auto after = std::chrono::high_resolution_clock::now();
+    txtime_offset_ = std::chrono::seconds{ts.tv_sec} +
+                     std::chrono::nanoseconds{ts.tv_nsec} -
+                     (before + (after - before) / 2).time_since_epoch();
+  }
+}
+
+void UdpTransport::send(const uint8_t *data, size_t len) {
+  if (txtime_clock_ >= 0) {
+    /* A query without a launch time would be dropped by the etf qdisc */
+    send_at(data, len, std::chrono::high_resolution_clock::now() + TXTIME_LEAD);
+    return;
+  }
+  if (::sendto(sock_, reinterpret_cast<const void *>(data), len, 0,
+               reinterpret_cast<const struct sockaddr *>(&server_),
+               sizeof(server_)) != (ssize_t)len) {
+    send_errors_++;
+    std::cerr << "Can't send packet." << std::endl;
+  }
+}
+
+void UdpTransport::send_at(
+    const uint8_t *data, size_t len,
+    std::chrono::high_resolution_clock::time_point launch) {
+  if (txtime_clock_ < 0) {
+    send(data, len);
+    return;
+  }
+  uint64_t txtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        launch.time_since_epoch() + txtime_offset_)
+                        .count();
+  struct iovec iov;
+  iov.iov_base = const_cast<uint8_t *>(data);
+  iov.iov_len = len;
+  union {
+    char buf[CMSG_SPACE(sizeof(uint64_t))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0x00, sizeof(control));
+  struct msghdr msg;
+  memset(&msg, 0x00, sizeof(msg));
+  msg.msg_name = &server_;
+  msg.msg_namelen = sizeof(server_);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_TXTIME;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+  memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+  if (::sendmsg(sock_, &msg, 0) != (ssize_t)len) {
+    send_errors_++;
+    std::cerr << "Can't send packet." << std::endl;
+  }
+}
+
+void UdpTransport::receive_errors() {
+  receives_ = 0;
+  for (;;) {
+    /* The dropped query is returned too, its beginning is enough */
+    uint8_t data[sizeof(DNSHeader)];
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = sizeof(data);
+    union {
+      char buf[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                          sizeof(struct sockaddr_in))];
+      struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0x00, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (::recvmsg(sock_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      return;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) {
+        struct sock_extended_err err;
+        memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+        if (err.ee_origin == SO_EE_ORIGIN_TXTIME) {
+          stats_.txtime_drops_++;
+        }
+      }
+    }
+  }
+}
+
+ssize_t UdpTransport::receive(uint8_t *buffer, size_t maxlen) {
+  struct sockaddr_in sender;
+  socklen_t sender_len;
+  ssize_t recvlen;
+
+  memset(&sender, 0x00, sizeof(sender));
+  sender_len = sizeof(sender);
+  if ((recvlen = ::recvfrom(sock_, buffer, maxlen, 0,
+                            reinterpret_cast<struct sockaddr *>(&sender),
+                            &sender_len)) > 0) {
+    /* Test whether the answer came from the DUT */
+    if (memcmp(reinterpret_cast<const void *>(&sender.sin_addr),
+               reinterpret_cast<const void *>(&server_.sin_addr),
+               sizeof(struct in_addr)) != 0 ||
+        sender.sin_port != server_.sin_port) {
+      char sender_text[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, reinterpret_cast<const void *>(&sender.sin_addr),
+                sender_text, sizeof(sender_text));
+      std::stringstream ss;
+      ss << "Received packet from other host than the DUT: [" << sender_text
+         << "]:" << ntohs(sender.sin_port);
+      throw TransportException{ss.str()};
+    }
+    /* Count the answers truncated by the DUT */
+    if ((size_t)recvlen >= sizeof(DNSHeader) &&
+        reinterpret_cast<const DNSHeader *>(buffer)->tc()) {
+      stats_.truncated_++;
+    }
+  }
+  /* The error queue takes from the receive buffer, so read it regularly */
+  if (txtime_clock_ >= 0 && (recvlen < 0 || ++receives_ == TXTIME_ERRORS)) {
+    int error = errno;
+    receive_errors();
+    errno = error;
+  }
+  return recvlen;
+}
+
+int UdpTransport::fd() { return sock_; }
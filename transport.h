@@ -0,0 +1,240 @@
+/* dns64perf++ - C++14 DNS64 performance tester
+ * Based on dns64perf by Gabor Lencse <lencse@sze.hu>
+ * (http://ipv6.tilb.sze.hu/dns64perf/)
+ * Copyright (C) 2017  Daniel Bakai <bakaid@kszk.bme.hu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/** @file
+ *  @brief Header for the query transports
+ */
+
+#ifndef TRANSPORT_H_INCLUDED_
+#define TRANSPORT_H_INCLUDED_
+
+#include "histogram.h"
+#include "raii_socket.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <vector>
+
+static const std::chrono::milliseconds TXTIME_LEAD{
+    2}; /**< Time between handing a query to the kernel and its launch time */
+static const uint32_t TXTIME_ERRORS =
+    64; /**< Number of answers between readings of the error queue */
+
+/**
+ * An std::exception class for the Transports.
+ */
+class TransportException : public std::exception {
+private:
+  std::string what_; /**< Exception string */
+public:
+  /**
+   * A constructor.
+   * @param what the exception string
+   */
+  TransportException(std::string what);
+
+  /**
+   * A getter for the exception string.
+   * @return the exception string
+   */
+  const char *what() const noexcept override;
+};
+
+/**
+ * Enum for the transport used to carry the queries.
+ */
+enum class TransportType { UDP, TCP, DoT, DoH };
+
+/**
+ * Connection level statistics collected by a Transport.
+ */
+struct TransportStats {
+  uint64_t handshakes_;         /**< Number of full TLS handshakes */
+  uint64_t resumed_handshakes_; /**< Number of resumed TLS handshakes */
+  std::chrono::nanoseconds
+      handshake_time_; /**< Time spent in full TLS handshakes */
+  std::chrono::nanoseconds
+      resumed_handshake_time_; /**< Time spent in resumed TLS handshakes */
+  std::chrono::high_resolution_clock::time_point
+      first_handshake_; /**< Start of the first TLS handshake */
+  std::chrono::high_resolution_clock::time_point
+      last_handshake_; /**< End of the last TLS handshake */
+  uint64_t disconnects_;       /**< Number of connections lost during test */
+  uint64_t stream_waits_; /**< Number of sends delayed by the stream limit */
+  std::chrono::nanoseconds
+      stream_wait_time_; /**< Time the sends spent waiting for a stream */
+  uint64_t stream_errors_; /**< Number of failed HTTP/2 streams */
+  uint64_t stream_timeouts_; /**< Number of HTTP/2 streams cancelled
+                                unanswered at the timeout of their query */
+  std::vector<Histogram>
+      connections_; /**< Latency histogram of each multiplexed connection */
+  uint64_t tcp_connections_; /**< Number of established TCP connections */
+  uint64_t tcp_failures_;    /**< Number of TCP connections failed */
+  uint64_t tcp_timeouts_; /**< Number of TCP connections closed unanswered at
+                             the timeout of their query */
+  uint64_t fastopen_connections_; /**< Number of connections with data in SYN */
+  Histogram connect_time_;  /**< TCP connection setup times in nanoseconds */
+  Histogram response_time_; /**< Times from setup to answer in nanoseconds */
+  Histogram exchange_time_; /**< Times from connect to answer in nanoseconds */
+  std::chrono::high_resolution_clock::time_point
+      first_connect_; /**< Start of the first TCP connection attempt */
+  std::chrono::high_resolution_clock::time_point
+      last_connect_;    /**< End of the last TCP connection setup */
+  uint64_t truncated_; /**< Number of UDP answers with the TC flag set */
+  uint64_t txtime_drops_; /**< Number of queries dropped by the qdisc for
+                             missing their launch time */
+  uint64_t send_errors_; /**< Number of queries that could not be sent */
+
+  TransportStats();
+
+  /**
+   * Adds the statistics of another transport to this one.
+   * @param rhs the statistics to add
+   * @return reference to this
+   */
+  TransportStats &operator+=(const TransportStats &rhs);
+};
+
+/**
+ * Abstract class for carrying DNS messages to and from the DUT.
+ * send() is called from the sender thread, receive() from the receiver thread.
+ */
+class Transport {
+protected:
+  struct sockaddr_in server_; /**< Address of the server */
+  struct timeval timeout_;    /**< Receive timeout */
+  TransportStats stats_;      /**< Connection statistics */
+  /** Number of queries that could not be sent, counted apart from stats_ as
+   *  the receiver thread sends the retransmissions */
+  std::atomic<uint64_t> send_errors_;
+  /** Number of connections lost during the test, counted apart from stats_
+   *  as both the sender and the receiver thread notice the losses */
+  std::atomic<uint64_t> disconnects_;
+
+public:
+  /**
+   * Constructor.
+   * @param server address of the server
+   * @param timeout receive timeout
+   */
+  Transport(const struct sockaddr_in &server, struct timeval timeout);
+
+  /**
+   * Destructor.
+   */
+  virtual ~Transport();
+
+  /**
+   * Sends one DNS message.
+   * @param data the message
+   * @param len length of the message
+   */
+  virtual void send(const uint8_t *data, size_t len) = 0;
+
+  /**
+   * Sends one DNS message at a given time. The transports that cannot
+   * schedule the transmission send it at once.
+   * @param data the message
+   * @param len length of the message
+   * @param launch the time of the transmission
+   */
+  virtual void send_at(const uint8_t *data, size_t len,
+                       std::chrono::high_resolution_clock::time_point launch);
+
+  /**
+   * Receives one DNS message, waiting at most for the timeout.
+   * @param buffer the buffer to receive into
+   * @param maxlen the length of the buffer
+   * @return the length of the message, or -1 with errno set to EWOULDBLOCK
+   * on timeout
+   */
+  virtual ssize_t receive(uint8_t *buffer, size_t maxlen) = 0;
+
+  /**
+   * Getter for the connection statistics.
+   * @return the statistics
+   */
+  virtual TransportStats stats() const;
+
+  /**
+   * Clears the connection statistics, when the transport is taken over by
+   * the tester of the next phase. The connections are kept.
+   */
+  virtual void reset_stats();
+};
+
+/**
+ * Class for sending queries over plain UDP.
+ * With a txtime clock, the queries are handed to the kernel ahead of time
+ * with an SCM_TXTIME launch time, and the qdisc of the interface (etf for
+ * CLOCK_TAI, fq for CLOCK_MONOTONIC) transmits them at that time.
+ */
+class UdpTransport : public Transport {
+private:
+  Socket sock_; /**< Socket for sending and receiving queries */
+  int txtime_clock_; /**< Clock of the launch times, or -1 */
+  std::chrono::nanoseconds
+      txtime_offset_; /**< Clock of the launch times minus the clock of the
+                         tester */
+  uint32_t receives_; /**< Number of answers since reading the errors */
+
+public:
+  /**
+   * Constructor.
+   * @param server address of the server
+   * @param timeout receive timeout
+   * @param txtime_clock clock of the launch times, or -1 to send the queries
+   * at once
+   */
+  UdpTransport(const struct sockaddr_in &server, struct timeval timeout,
+               int txtime_clock = -1);
+
+  /**
+   * Sends one DNS message, TXTIME_LEAD later with a txtime clock.
+   * @param data the message
+   * @param len length of the message
+   */
+  void send(const uint8_t *data, size_t len) override;
+
+  void send_at(const uint8_t *data, size_t len,
+               std::chrono::high_resolution_clock::time_point launch) override;
+
+  ssize_t receive(uint8_t *buffer, size_t maxlen) override;
+
+  /**
+   * Reads the error queue of the socket, counting the queries the qdisc
+   * dropped for missing their launch time.
+   */
+  void receive_errors();
+
+  /**
+   * Getter for the socket, to wait for answers with poll.
+   * @return the socket
+   */
+  int fd();
+};
+
+#endif